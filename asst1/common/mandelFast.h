@@ -0,0 +1,69 @@
+#ifndef _MANDEL_FAST_H
+#define _MANDEL_FAST_H
+
+// Mandelbrot iteration count with shortcuts for points inside the set,
+// shared by the serial and threaded code of prog1 and (through
+// mandelFast.isph, which must be kept in sync) the ISPC code of prog3.
+//
+// mandelFast() returns exactly what the brute-force mandel() returns
+// when iterating in float:
+//
+// * Points in the main cardioid or the period-2 bulb never escape, so
+//   they get count without iterating. The tests are shrunk slightly so
+//   that rounding can never let a point near their boundaries through.
+// * Other points are checked for cycles Brent-style: z is saved at
+//   iterations 1, 2, 4, 8, ... and compared with every later z. Float
+//   iteration is deterministic, so once z repeats exactly the orbit is
+//   periodic and will never escape either.
+//
+// The float operations of the iteration itself are those of mandel(),
+// so code using mandelFast() must also be built without fused
+// multiply-adds to stay bit-identical.
+
+// Margin of the cardioid and bulb tests.
+static const float kMandelInteriorMargin = 1.f / 1024;
+
+static inline bool mandelInterior(float c_re, float c_im) {
+  // Main cardioid: q (q + x - 1/4) < y^2 / 4, q = (x - 1/4)^2 + y^2.
+  float xq = c_re - 0.25f;
+  float y2 = c_im * c_im;
+  float q = xq * xq + y2;
+  if (q * (q + xq) < 0.25f * y2 - kMandelInteriorMargin)
+    return true;
+
+  // Period-2 bulb: (x + 1)^2 + y^2 < 1/16.
+  float xb = c_re + 1.f;
+  return xb * xb + y2 < 0.0625f - kMandelInteriorMargin;
+}
+
+static inline int mandelFast(float c_re, float c_im, int count) {
+  if (mandelInterior(c_re, c_im))
+    return count;
+
+  float z_re = c_re, z_im = c_im;
+  float saved_re = z_re, saved_im = z_im;
+  int checkAt = 1;
+  int i;
+  for (i = 0; i < count; ++i) {
+
+    if (z_re * z_re + z_im * z_im > 4.f)
+      break;
+
+    float new_re = z_re * z_re - z_im * z_im;
+    float new_im = 2.f * z_re * z_im;
+    z_re = c_re + new_re;
+    z_im = c_im + new_im;
+
+    if (z_re == saved_re && z_im == saved_im)
+      return count;
+    if (i + 1 == checkAt) {
+      saved_re = z_re;
+      saved_im = z_im;
+      checkAt *= 2;
+    }
+  }
+
+  return i;
+}
+
+#endif
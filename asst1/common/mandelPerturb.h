@@ -0,0 +1,128 @@
+#ifndef _MANDEL_PERTURB_H
+#define _MANDEL_PERTURB_H
+
+#include <vector>
+
+// Perturbation-theory rendering for deep zooms, shared by prog1 and
+// (through the ISPC kernel in mandelbrot.ispc, which must be kept in
+// sync with mandelPerturb() below) prog3.
+//
+// Past a zoom of about 1e-6, float pixel coordinates no longer differ
+// from their neighbors, and past about 1e-15 neither do doubles. Instead
+// of iterating every pixel in a slow high-precision type, one reference
+// orbit Z_n is computed in __float128 at the center C of the view, and
+// each pixel c = C + dc only iterates its difference d_n = z_n - Z_n in
+// double:
+//
+//   d_{n+1} = (2 Z_n + d_n) d_n + dc
+//
+// The pixel orbit drifts away from the reference where |z_n| becomes
+// smaller than |d_n| (the classic perturbation glitch) or when the
+// reference escapes first. Both are detected, and the pixel is rebased
+// onto the start of the reference orbit: d = z_n, n = 0 (Z_0 = 0).
+//
+// Iteration counts follow mandel(): the count of a pixel is the number
+// of z_1 = c, z_2, ... that are checked before one has |z|^2 > 4.
+
+// The view selected by -v 3: a point near the seahorse valley, given as
+// a high and a low double each, and the width of the view.
+static const double kDeepCenterRe[2] = {-0.7436438870371587,
+                                        -4.752191506114774e-18};
+static const double kDeepCenterIm[2] = {0.13182590420531198,
+                                        -9.506867861e-18};
+static const double kDeepWidth = 3e-12;
+static const int kDeepMaxIterations = 5000;
+
+//
+// mandelReferenceOrbit --
+//
+// Computes Z_0 = 0, Z_1 = C, ... in __float128 for C = cRe + i cIm
+// (each the sum of a high and a low double), until an element escapes
+// or maxIterations elements after Z_0. Returns the orbit rounded to
+// double; its last element is the escaping one, if any.
+static inline void mandelReferenceOrbit(const double cRe[2],
+                                        const double cIm[2],
+                                        int maxIterations,
+                                        std::vector<double> &orbitRe,
+                                        std::vector<double> &orbitIm) {
+  __float128 c_re = (__float128)cRe[0] + cRe[1];
+  __float128 c_im = (__float128)cIm[0] + cIm[1];
+  __float128 z_re = 0, z_im = 0;
+
+  orbitRe.assign(1, 0.0);
+  orbitIm.assign(1, 0.0);
+  for (int i = 0; i < maxIterations; ++i) {
+    __float128 new_re = z_re * z_re - z_im * z_im;
+    __float128 new_im = 2 * z_re * z_im;
+    z_re = c_re + new_re;
+    z_im = c_im + new_im;
+    orbitRe.push_back((double)z_re);
+    orbitIm.push_back((double)z_im);
+    if (z_re * z_re + z_im * z_im > 4)
+      break;
+  }
+}
+
+//
+// mandelPerturb --
+//
+// Iteration count of the pixel C + dc against a reference orbit of
+// orbitLength elements. Adds the number of rebases to *rebases.
+static inline int mandelPerturb(double dc_re, double dc_im,
+                                const double orbitRe[], const double orbitIm[],
+                                int orbitLength, int count, int *rebases) {
+  double d_re = 0, d_im = 0;
+  int m = 0;
+  int i;
+  for (i = 0; i < count; ++i) {
+    double t_re = 2 * orbitRe[m] + d_re;
+    double t_im = 2 * orbitIm[m] + d_im;
+    double new_re = t_re * d_re - t_im * d_im + dc_re;
+    double new_im = t_re * d_im + t_im * d_re + dc_im;
+    d_re = new_re;
+    d_im = new_im;
+    m++;
+
+    double z_re = orbitRe[m] + d_re;
+    double z_im = orbitIm[m] + d_im;
+    double z2 = z_re * z_re + z_im * z_im;
+    if (z2 > 4.)
+      break;
+
+    if (z2 < d_re * d_re + d_im * d_im || m == orbitLength - 1) {
+      d_re = z_re;
+      d_im = z_im;
+      m = 0;
+      (*rebases)++;
+    }
+  }
+
+  return i;
+}
+
+//
+// mandelQuad --
+//
+// Brute-force iteration count of C + dc in __float128, to validate
+// mandelPerturb() (and to show what it saves).
+static inline int mandelQuad(const double cRe[2], const double cIm[2],
+                             double dc_re, double dc_im, int count) {
+  __float128 c_re = (__float128)cRe[0] + cRe[1] + dc_re;
+  __float128 c_im = (__float128)cIm[0] + cIm[1] + dc_im;
+  __float128 z_re = c_re, z_im = c_im;
+  int i;
+  for (i = 0; i < count; ++i) {
+
+    if (z_re * z_re + z_im * z_im > 4)
+      break;
+
+    __float128 new_re = z_re * z_re - z_im * z_im;
+    __float128 new_im = 2 * z_re * z_im;
+    z_re = c_re + new_re;
+    z_im = c_im + new_im;
+  }
+
+  return i;
+}
+
+#endif
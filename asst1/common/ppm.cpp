@@ -2,9 +2,65 @@
 #include <stdio.h>
 #include <math.h>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
 
 
+static inline unsigned char
+iterationsToGray(int iterations, int maxIterations)
+{
+    // Clamp iteration count for this pixel, then scale the value
+    // to 0-1 range.  Raise resulting value to a power (<1) to
+    // increase brightness of low iteration count
+    // pixels. a.k.a. Make things look cooler.
+
+    float mapped = pow( std::min(static_cast<float>(maxIterations),
+                                 static_cast<float>(iterations)) / 256.f, .5f);
+
+    // convert back into 0-255 range, 8-bit channels
+    return static_cast<unsigned char>(255.f * mapped);
+}
+
+// Largest iteration count with an entry in grayTable().
+static const int kMaxGrayTableIndex = 1 << 16;
+
+// Gray level of the iteration counts from 0 to maxIterations (or
+// kMaxGrayTableIndex), so that converting a pixel takes a table lookup
+// instead of a pow().
+static std::vector<unsigned char>
+grayTable(int maxIterations)
+{
+    int size = std::max(0, std::min(maxIterations, kMaxGrayTableIndex)) + 1;
+    std::vector<unsigned char> table(size);
+    for (int i = 0; i < size; i++)
+        table[i] = iterationsToGray(i, maxIterations);
+    return table;
+}
+
+// Converts iteration counts to RGB pixels through grayTable(), falling
+// back to iterationsToGray() for counts outside of the table.
+static void
+convertToRGB(const int* data, size_t numPixels,
+             const std::vector<unsigned char>& table, int maxIterations,
+             unsigned char* rgb)
+{
+    unsigned int tableSize = table.size();
+    for (size_t i = 0; i < numPixels; i++) {
+        unsigned char result = (unsigned int)data[i] < tableSize
+                                   ? table[data[i]]
+                                   : iterationsToGray(data[i], maxIterations);
+        rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = result;
+    }
+}
+
+// Images below this many pixels are converted on the calling thread.
+static const size_t kMinParallelPixels = 1 << 18;
+
 void
 writePPMImage(int* data, int width, int height, const char *filename, int maxIterations)
 {
@@ -15,21 +71,117 @@ writePPMImage(int* data, int width, int height, const char *filename, int maxIte
     fprintf(fp, "%d %d\n", width, height);
     fprintf(fp, "255\n");
 
-    for (int i = 0; i < width*height; ++i) {
+    // convert all pixels into one buffer, in parallel for large images,
+    // and write it at once
+    size_t numPixels = (size_t)width * height;
+    std::vector<unsigned char> table = grayTable(maxIterations);
+    std::vector<unsigned char> rgb(3 * numPixels);
 
-        // Clamp iteration count for this pixel, then scale the value
-        // to 0-1 range.  Raise resulting value to a power (<1) to
-        // increase brightness of low iteration count
-        // pixels. a.k.a. Make things look cooler.
+    int numThreads = 1;
+    if (numPixels >= kMinParallelPixels)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = (numPixels + numThreads - 1) / numThreads;
 
-        float mapped = pow( std::min(static_cast<float>(maxIterations),
-                                     static_cast<float>(data[i])) / 256.f, .5f);
-
-        // convert back into 0-255 range, 8-bit channels
-        unsigned char result = static_cast<unsigned char>(255.f * mapped);
-        for (int j = 0; j < 3; ++j)
-            fputc(result, fp);
+    std::vector<std::thread> workers;
+    // rounding chunk up can leave the last threads without pixels
+    for (int t = 1; t < numThreads && t * chunk < numPixels; t++) {
+        size_t start = t * chunk;
+        size_t count = std::min(chunk, numPixels - start);
+        workers.push_back(std::thread(convertToRGB, data + start, count,
+                                      std::cref(table), maxIterations,
+                                      rgb.data() + 3 * start));
     }
+    convertToRGB(data, std::min(chunk, numPixels), table, maxIterations,
+                 rgb.data());
+    for (auto &w : workers)
+        w.join();
+
+    fwrite(rgb.data(), 1, rgb.size(), fp);
     fclose(fp);
     printf("Wrote image file %s\n", filename);
 }
+
+// Renders a band of rows: fills band[] (numRows * width counts, indexed
+// from startRow) with the iteration counts of rows startRow ..
+// startRow + numRows - 1.
+typedef void (*RenderBandFunc)(void *context, int startRow, int numRows,
+                               int band[]);
+
+// Renders a width x height image straight into a PPM file, for images
+// too large to hold in memory. numThreads threads each claim the next
+// band of bandRows rows, render it with renderBand, convert it to pixels
+// and pwrite() it at its place in the file, so memory use is bounded by
+// numThreads bands whatever the image size. Returns the number of bytes
+// of band buffers used, or -1 if the file cannot be written.
+long long
+writePPMImageStreaming(const char *filename, int width, int height,
+                       int maxIterations, int numThreads, int bandRows,
+                       RenderBandFunc renderBand, void *context)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(filename);
+        return -1;
+    }
+
+    char header[64];
+    int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+                              width, height);
+    long long rowBytes = 3LL * width;
+    if (pwrite(fd, header, headerSize, 0) != headerSize ||
+        ftruncate(fd, headerSize + rowBytes * height) != 0) {
+        perror(filename);
+        close(fd);
+        return -1;
+    }
+
+    numThreads = std::max(1, numThreads);
+    bandRows = std::max(1, std::min(bandRows, height));
+    int numBands = (height + bandRows - 1) / bandRows;
+    std::atomic<int> nextBand(0);
+    std::atomic<bool> failed(false);
+    std::vector<unsigned char> table = grayTable(maxIterations);
+
+    auto worker = [&]() {
+        std::vector<int> band((size_t)bandRows * width);
+        std::vector<unsigned char> pixels((size_t)bandRows * rowBytes);
+        int b;
+        while ((b = nextBand.fetch_add(1)) < numBands && !failed) {
+            int startRow = b * bandRows;
+            int numRows = std::min(bandRows, height - startRow);
+            renderBand(context, startRow, numRows, band.data());
+
+            size_t numPixels = (size_t)numRows * width;
+            convertToRGB(band.data(), numPixels, table, maxIterations,
+                         pixels.data());
+
+            // pwrite() may write less than asked for, e.g. past 2GB
+            size_t done = 0, size = numPixels * 3;
+            off_t offset = headerSize + rowBytes * startRow;
+            while (done < size) {
+                ssize_t n = pwrite(fd, pixels.data() + done, size - done,
+                                   offset + done);
+                if (n <= 0) {
+                    failed = true;
+                    break;
+                }
+                done += n;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < numThreads; i++)
+        workers.push_back(std::thread(worker));
+    worker();
+    for (auto &t : workers)
+        t.join();
+
+    if (close(fd) != 0 || failed) {
+        fprintf(stderr, "Error writing %s\n", filename);
+        return -1;
+    }
+    printf("Wrote image file %s\n", filename);
+    return (long long)numThreads * bandRows * width *
+           (sizeof(int) + 3 * sizeof(unsigned char));
+}
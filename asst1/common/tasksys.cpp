@@ -43,6 +43,17 @@
   There are three task systems in this file: one built using Microsoft's
   Concurrency Runtime, one built with Apple's Grand Central Dispatch, and
   one built on top of bare pthreads.
+
+  On Linux, defining ISPC_USE_WORK_STEALING replaces the pthreads task
+  system's single locked queue with per-thread deques of task index
+  ranges that idle threads steal from.
+
+  The pthreads task systems can also be started and stopped explicitly,
+  with a chosen thread count and optional pinning; see tasksys.h.
+
+  Defining ISPC_USE_ITASKSYS adds ISPCSetTaskSystem(), which makes later
+  launches run as bulk launches on an asst2 ITaskSystem instead of on
+  the built-in task system.
 */
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -72,7 +83,6 @@
 #endif // ISPC_USE_GCD
 #ifdef ISPC_USE_PTHREADS
   #include <pthread.h>
-  #include <semaphore.h>
   #include <unistd.h>
   #include <fcntl.h>
   #include <errno.h>
@@ -81,7 +91,18 @@
   #include <sys/param.h>
   #include <vector>
   #include <algorithm>
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <sched.h>
+  #include <limits.h>
 #endif // ISPC_USE_PTHREADS
+#ifdef ISPC_USE_WORK_STEALING
+  #include <deque>
+#endif // ISPC_USE_WORK_STEALING
+#ifdef ISPC_USE_ITASKSYS
+  #include <vector>
+  #include "itasksys.h"
+#endif // ISPC_USE_ITASKSYS
 #ifdef ISPC_IS_LINUX
   #include <malloc.h>
 #endif // ISPC_IS_LINUX
@@ -92,6 +113,8 @@
 #include <string.h>
 #include <algorithm>
 
+#include "tasksys.h"
+
 // Signature of ispc-generated 'task' functions
 typedef void (*TaskFuncType)(void *data, int threadIndex, int threadCount,
                              int taskIndex, int taskCount);
@@ -133,6 +156,13 @@ public:
 
     void *AllocMemory(int64_t size, int32_t alignment);
 
+#ifdef ISPC_USE_ITASKSYS
+    /* Task system this group's launches are forwarded to (NULL for the
+       built-in one), and the runnables of its forwarded launches. */
+    ITaskSystem *forwardTo;
+    std::vector<IRunnable *> forwardedLaunches;
+#endif // ISPC_USE_ITASKSYS
+
 protected:
     TaskGroupBase();
     ~TaskGroupBase();
@@ -161,6 +191,9 @@ private:
 
 inline TaskGroupBase::TaskGroupBase() { 
     nextTaskInfoIndex = 0; 
+#ifdef ISPC_USE_ITASKSYS
+    forwardTo = NULL;
+#endif // ISPC_USE_ITASKSYS
 
     curMemBuffer = 0; 
     curMemBufferOffset = 0;
@@ -187,6 +220,9 @@ inline TaskGroupBase::~TaskGroupBase() {
 inline void
 TaskGroupBase::Reset() {
     nextTaskInfoIndex = 0; 
+#ifdef ISPC_USE_ITASKSYS
+    forwardTo = NULL;
+#endif // ISPC_USE_ITASKSYS
     curMemBuffer = 0; 
     curMemBufferOffset = 0;
 }
@@ -333,7 +369,35 @@ private:
 };
 #endif // ISPC_USE_GCD
 
-#ifdef ISPC_USE_PTHREADS
+#if defined(ISPC_USE_PTHREADS) && defined(ISPC_USE_WORK_STEALING)
+static void *lTaskEntry(void *arg);
+static bool lRunOneTask(int threadIndex);
+
+/* With work stealing, the tasks of a launch live as an index range in
+   the launching thread's deque; the task group only counts the tasks
+   that have not finished yet. */
+class TaskGroup : public TaskGroupBase {
+public:
+    TaskGroup() {
+        numUnfinishedTasks = 0;
+    }
+
+    void Reset() {
+        TaskGroupBase::Reset();
+        numUnfinishedTasks = 0;
+        lMemFence();
+    }
+
+    void Launch(int baseIndex, int count);
+    void Sync();
+
+private:
+    friend bool lRunOneTask(int threadIndex);
+
+    int32_t numUnfinishedTasks;
+};
+
+#elif defined(ISPC_USE_PTHREADS)
 static void *lTaskEntry(void *arg);
 
 class TaskGroup : public TaskGroupBase {
@@ -482,10 +546,6 @@ static volatile int32_t lock = 0;
 static int nThreads;
 static pthread_t *threads = NULL;
 
-static pthread_mutex_t taskSysMutex;
-static std::vector<TaskGroup *> activeTaskGroups;
-static sem_t *workerSemaphore;
-
 
 static inline int32_t 
 lAtomicAdd(int32_t *v, int32_t delta) {
@@ -498,6 +558,67 @@ lAtomicAdd(int32_t *v, int32_t delta) {
 }
 
 
+/* Idle workers sleep on a futex-based eventcount.  A worker that found no
+   work snapshots wakeSequence, announces itself in numIdleWorkers and
+   checks for work once more before sleeping.  A launch publishes its
+   tasks, then, only if some worker is idle, bumps wakeSequence and wakes
+   at most one idle worker per launched task with a single FUTEX_WAKE.
+   Both sides separate their write from their read with a full barrier,
+   so either the worker sees the new tasks or the launcher sees the
+   worker; and a worker that announced itself but has not gone to sleep
+   yet finds wakeSequence changed and does not sleep at all.
+ */
+static int32_t wakeSequence = 0;
+static int32_t numIdleWorkers = 0;
+
+// Set while ISPCShutdownTaskSystem() waits for the workers to exit
+static volatile int32_t shutdownRequested = 0;
+
+static bool lHasQueuedTasks();
+
+
+static void
+lWaitForWork() {
+    int32_t sequence = *(volatile int32_t *)&wakeSequence;
+    lAtomicAdd(&numIdleWorkers, 1);
+    if (!lHasQueuedTasks() && !shutdownRequested) {
+        if (syscall(SYS_futex, &wakeSequence, FUTEX_WAIT_PRIVATE, sequence,
+                    NULL, NULL, 0) != 0 && errno != EAGAIN && errno != EINTR) {
+            fprintf(stderr, "Error from futex wait: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    lAtomicAdd(&numIdleWorkers, -1);
+}
+
+
+static void
+lWakeWorkers(int count) {
+    lMemFence();
+    int32_t idle = *(volatile int32_t *)&numIdleWorkers;
+    if (idle == 0)
+        return;
+    lAtomicAdd(&wakeSequence, 1);
+    syscall(SYS_futex, &wakeSequence, FUTEX_WAKE_PRIVATE, std::min(count, idle),
+            NULL, NULL, 0);
+}
+
+
+#ifndef ISPC_USE_WORK_STEALING
+
+static pthread_mutex_t taskSysMutex;
+static std::vector<TaskGroup *> activeTaskGroups;
+
+
+static bool
+lHasQueuedTasks() {
+    pthread_mutex_lock(&taskSysMutex);
+    bool hasTasks = activeTaskGroups.size() > 0;
+    pthread_mutex_unlock(&taskSysMutex);
+    return hasTasks;
+}
+
+
 static void *
 lTaskEntry(void *arg) {
     int threadIndex = (int)((int64_t)arg);
@@ -505,15 +626,6 @@ lTaskEntry(void *arg) {
 
     while (1) {
         int err;
-        //
-        // Wait on the semaphore until we're woken up due to the arrival of
-        // more work.
-        //
-        if ((err = sem_wait(workerSemaphore)) != 0) {
-            fprintf(stderr, "Error from sem_wait: %s\n", strerror(err));
-            exit(1);
-        }
-
         //
         // Acquire the mutex
         //
@@ -524,12 +636,15 @@ lTaskEntry(void *arg) {
 
         if (activeTaskGroups.size() == 0) {
             //
-            // Task queue is empty, go back and wait on the semaphore
+            // Task queue is empty, sleep until a launch adds more work
             //
             if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
                 fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
                 exit(1);
             }
+            if (shutdownRequested)
+                break;
+            lWaitForWork();
             continue;
         }
 
@@ -576,55 +691,29 @@ lTaskEntry(void *arg) {
 
 
 static void
-InitTaskSystem() {
-    if (threads == NULL) {
-        while (1) {
-            if (lAtomicCompareAndSwap32(&lock, 1, 0) == 0) {
-                if (threads == NULL) {
-                    // We launch one fewer thread than there are cores,
-                    // since the main thread here will also grab jobs from
-                    // the task queue itself.
-                    nThreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
-
-                    int err;
-                    if ((err = pthread_mutex_init(&taskSysMutex, NULL)) != 0) {
-                        fprintf(stderr, "Error creating mutex: %s\n", strerror(err));
-                        exit(1);
-                    }
-
-                    char name[32];
-                    sprintf(name, "ispc_task.%d", (int)getpid());
-                    workerSemaphore = sem_open(name, O_CREAT, S_IRUSR|S_IWUSR, 0);
-                    if (!workerSemaphore) {
-                        fprintf(stderr, "Error creating semaphore: %s\n", strerror(err));
-                        exit(1);
-                    }
-
-                    threads = (pthread_t *)malloc(nThreads * sizeof(pthread_t));
-                    for (intptr_t i = 0; i < nThreads; ++i) {
-                        err = pthread_create(&threads[i], NULL, &lTaskEntry, (void *) i);
-                        if (err != 0) {
-                            fprintf(stderr, "Error creating pthread %lu: %s\n", i, strerror(err));
-                            exit(1);
-                        }
-                    }
-
-                    activeTaskGroups.reserve(64);
-                }
-
-                // Make sure all of the above goes to memory before we
-                // clear the lock.
-                lMemFence();
-                lock = 0;
-                break;
-            }
-        }
+lCreateQueues() {
+    int err;
+    if ((err = pthread_mutex_init(&taskSysMutex, NULL)) != 0) {
+        fprintf(stderr, "Error creating mutex: %s\n", strerror(err));
+        exit(1);
     }
+    activeTaskGroups.reserve(64);
+}
+
+
+static void
+lDestroyQueues() {
+    assert(activeTaskGroups.size() == 0);
+    pthread_mutex_destroy(&taskSysMutex);
 }
 
 
 inline void
 TaskGroup::Launch(int baseCoord, int count) {
+    // A group with no waiting tasks must not go on the active list
+    if (count <= 0)
+        return;
+
     //
     // Acquire mutex, add task
     //
@@ -664,14 +753,10 @@ TaskGroup::Launch(int baseCoord, int count) {
     lAtomicAdd(&numUnfinishedTasks, count);
 
     //
-    // Post to the worker semaphore to wake up worker threads that are
-    // sleeping waiting for tasks to show up
+    // Wake up worker threads that are sleeping waiting for tasks to show
+    // up
     //
-    for (int i = 0; i < count; ++i)
-        if ((err = sem_post(workerSemaphore)) != 0) {
-            fprintf(stderr, "Error from sem_post: %s\n", strerror(err));
-            exit(1);
-        }
+    lWakeWorkers(count);
 }
 
 
@@ -768,6 +853,387 @@ TaskGroup::Sync() {
     DBG(fprintf(stderr, "sync for %p done!n", tg));
 }
 
+#else // ISPC_USE_WORK_STEALING
+
+/* A work-stealing variant of the pthreads task system.  Every thread owns
+   a deque of index ranges; ISPCLaunch pushes the whole launch onto the
+   calling thread's deque as a single range, instead of pushing one entry
+   per task onto a global list.  A thread takes work one task at a time
+   from the back of its own deque, and an idle thread steals half of the
+   range at the front of another thread's deque.  Threads that are not
+   workers (such as the main thread) share one extra deque.  Each deque
+   has its own lock, so launches and task pickup on different threads no
+   longer serialize on one mutex.
+ */
+
+struct TaskRange {
+    TaskGroup *tg;
+    int begin, end;
+};
+
+struct TaskDeque {
+    pthread_mutex_t mutex;
+    std::deque<TaskRange> ranges;
+    char pad[64];
+};
+
+static TaskDeque *taskDeques;
+
+// Task indices pushed to a deque but not yet claimed by any thread
+static int32_t numQueuedTasks = 0;
+
+// Index of this thread's deque; nThreads for non-worker threads.
+static __thread int lThreadIndex = -1;
+
+
+static bool
+lHasQueuedTasks() {
+    return *(volatile int32_t *)&numQueuedTasks > 0;
+}
+
+
+static inline int
+lCurrentThreadIndex() {
+    return (lThreadIndex < 0) ? nThreads : lThreadIndex;
+}
+
+
+static inline void
+lLock(pthread_mutex_t *mutex) {
+    int err;
+    if ((err = pthread_mutex_lock(mutex)) != 0) {
+        fprintf(stderr, "Error from pthread_mutex_lock: %s\n", strerror(err));
+        exit(1);
+    }
+}
+
+
+static inline void
+lUnlock(pthread_mutex_t *mutex) {
+    int err;
+    if ((err = pthread_mutex_unlock(mutex)) != 0) {
+        fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
+        exit(1);
+    }
+}
+
+
+/* Takes one task from the back of deque q.  Returns false if q is empty.
+   Launch never queues an empty range, but any that shows up is dropped
+   rather than handed out. */
+static bool
+lPopTask(TaskDeque *q, TaskGroup **tg, int *index) {
+    lLock(&q->mutex);
+    while (!q->ranges.empty() && q->ranges.back().begin >= q->ranges.back().end)
+        q->ranges.pop_back();
+    if (q->ranges.empty()) {
+        lUnlock(&q->mutex);
+        return false;
+    }
+    TaskRange &r = q->ranges.back();
+    *tg = r.tg;
+    *index = --r.end;
+    if (r.begin == r.end)
+        q->ranges.pop_back();
+    lUnlock(&q->mutex);
+    return true;
+}
+
+
+/* Steals the first half of the range at the front of deque victim.
+   Returns false if victim is empty; empty ranges are dropped, as in
+   lPopTask. */
+static bool
+lStealRange(TaskDeque *victim, TaskRange *stolen) {
+    lLock(&victim->mutex);
+    while (!victim->ranges.empty() &&
+           victim->ranges.front().begin >= victim->ranges.front().end)
+        victim->ranges.pop_front();
+    if (victim->ranges.empty()) {
+        lUnlock(&victim->mutex);
+        return false;
+    }
+    TaskRange &r = victim->ranges.front();
+    int half = (r.end - r.begin + 1) / 2;
+    stolen->tg = r.tg;
+    stolen->begin = r.begin;
+    stolen->end = r.begin + half;
+    r.begin += half;
+    if (r.begin == r.end)
+        victim->ranges.pop_front();
+    lUnlock(&victim->mutex);
+    return true;
+}
+
+
+/* Finds one task, from this thread's deque or else by stealing, and runs
+   it.  Returns false if there was no work anywhere. */
+static bool
+lRunOneTask(int threadIndex) {
+    TaskGroup *tg = NULL;
+    int index;
+
+    if (!lPopTask(&taskDeques[threadIndex], &tg, &index)) {
+        for (int i = 1; i <= nThreads && tg == NULL; ++i) {
+            int victim = (threadIndex + i) % (nThreads + 1);
+            TaskRange stolen;
+            if (!lStealRange(&taskDeques[victim], &stolen))
+                continue;
+
+            // Run the first stolen task ourselves and make the rest
+            // available from our own deque.
+            tg = stolen.tg;
+            index = stolen.begin++;
+            if (stolen.begin < stolen.end) {
+                TaskDeque *q = &taskDeques[threadIndex];
+                lLock(&q->mutex);
+                q->ranges.push_back(stolen);
+                lUnlock(&q->mutex);
+            }
+        }
+        if (tg == NULL)
+            return false;
+    }
+    lAtomicAdd(&numQueuedTasks, -1);
+
+    DBG(fprintf(stderr, "running task %d from group %p\n", index, tg));
+    TaskInfo *myTask = tg->GetTaskInfo(index);
+    myTask->func(myTask->data, threadIndex, nThreads + 1, myTask->taskIndex,
+                 myTask->taskCount);
+
+    lMemFence();
+    lAtomicAdd(&tg->numUnfinishedTasks, -1);
+    return true;
+}
+
+
+static void *
+lTaskEntry(void *arg) {
+    lThreadIndex = (int)((int64_t)arg);
+
+    while (1) {
+        if (lRunOneTask(lThreadIndex))
+            continue;
+
+        // No work anywhere: sleep until a launch queues more
+        if (shutdownRequested)
+            break;
+        lWaitForWork();
+    }
+
+    pthread_exit(NULL);
+    return 0;
+}
+
+
+static void
+lCreateQueues() {
+    taskDeques = new TaskDeque[nThreads + 1];
+    for (int i = 0; i <= nThreads; ++i) {
+        int err;
+        if ((err = pthread_mutex_init(&taskDeques[i].mutex, NULL)) != 0) {
+            fprintf(stderr, "Error creating mutex: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+}
+
+
+static void
+lDestroyQueues() {
+    assert(numQueuedTasks == 0);
+    for (int i = 0; i <= nThreads; ++i)
+        pthread_mutex_destroy(&taskDeques[i].mutex);
+    delete[] taskDeques;
+    taskDeques = NULL;
+}
+
+
+inline void
+TaskGroup::Launch(int baseIndex, int count) {
+    // An empty range would let a thief run a task that was never launched
+    if (count <= 0)
+        return;
+
+    // Count the tasks before they become visible so that no thief can
+    // finish one and drive the counter below zero.
+    lAtomicAdd(&numUnfinishedTasks, count);
+
+    TaskRange r = { this, baseIndex, baseIndex + count };
+    TaskDeque *q = &taskDeques[lCurrentThreadIndex()];
+    lLock(&q->mutex);
+    q->ranges.push_back(r);
+    lUnlock(&q->mutex);
+
+    lAtomicAdd(&numQueuedTasks, count);
+    lWakeWorkers(count);
+}
+
+
+inline void
+TaskGroup::Sync() {
+    DBG(fprintf(stderr, "syncing %p - %d unfinished\n", this, numUnfinishedTasks));
+
+    // Help out until every task of this group has finished: first with
+    // our own deque (which holds this group's untouched tasks), then by
+    // stealing.  When there is nothing left to take, the remaining tasks
+    // are running on other threads.
+    int threadIndex = lCurrentThreadIndex();
+    while (numUnfinishedTasks > 0) {
+        if (!lRunOneTask(threadIndex))
+            sched_yield();
+    }
+    DBG(fprintf(stderr, "sync for %p done!n", this));
+}
+
+#endif // ISPC_USE_WORK_STEALING
+
+
+/* CPU limit imposed by the cgroup CPU quota (cgroup v2 cpu.max, or the
+   v1 cfs quota and period), rounded up; 0 if there is no quota. */
+static int
+lCgroupCpuLimit() {
+    long quota = -1, period = 0;
+    FILE *f = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (f != NULL) {
+        char quotaStr[32];
+        if (fscanf(f, "%31s %ld", quotaStr, &period) == 2 && strcmp(quotaStr, "max") != 0)
+            quota = atol(quotaStr);
+        fclose(f);
+    }
+    else {
+        f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+        if (f != NULL) {
+            if (fscanf(f, "%ld", &quota) != 1)
+                quota = -1;
+            fclose(f);
+        }
+        f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+        if (f != NULL) {
+            if (fscanf(f, "%ld", &period) != 1)
+                period = 0;
+            fclose(f);
+        }
+    }
+    if (quota <= 0 || period <= 0)
+        return 0;
+    return (int)std::max((quota + period - 1) / period, 1L);
+}
+
+
+/* Default number of threads (workers plus the syncing thread): the
+   ISPC_NUM_THREADS environment variable if set, otherwise the number of
+   CPUs this process may run on, capped by its cgroup CPU quota. */
+static int
+lDefaultThreadCount() {
+    const char *env = getenv("ISPC_NUM_THREADS");
+    if (env != NULL && atoi(env) > 0)
+        return atoi(env);
+
+    int numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+        numCpus = CPU_COUNT(&cpus);
+    int limit = lCgroupCpuLimit();
+    if (limit > 0)
+        numCpus = std::min(numCpus, limit);
+    return std::max(numCpus, 1);
+}
+
+
+/* Starts numThreads - 1 workers, since the syncing thread also runs
+   tasks.  With pinThreads, worker i is pinned to the (i+1)-th CPU of the
+   process affinity mask, wrapping around, leaving the first CPU to the
+   caller (which is not pinned).  Must be called with lock held. */
+static void
+lStartWorkers(int numThreads, bool pinThreads) {
+    int numWorkers = std::max(numThreads - 1, 0);
+    nThreads = numWorkers;
+    lCreateQueues();
+
+    std::vector<int> cpuList;
+    cpu_set_t cpus;
+    if (pinThreads && sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &cpus))
+                cpuList.push_back(cpu);
+    }
+
+    // Never NULL, even without workers: threads != NULL means "running".
+    pthread_t *newThreads = (pthread_t *)malloc((numWorkers + 1) * sizeof(pthread_t));
+    for (intptr_t i = 0; i < numWorkers; ++i) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (cpuList.size() > 0) {
+            cpu_set_t cpu;
+            CPU_ZERO(&cpu);
+            CPU_SET(cpuList[(i + 1) % cpuList.size()], &cpu);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+        }
+        int err = pthread_create(&newThreads[i], &attr, &lTaskEntry, (void *) i);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            fprintf(stderr, "Error creating pthread %lu: %s\n", i, strerror(err));
+            exit(1);
+        }
+    }
+
+    // Publish threads last: it is what InitTaskSystem() tests to skip
+    // initialization.
+    lMemFence();
+    threads = newThreads;
+}
+
+
+/* Stops and joins all workers.  No tasks may be running or queued.  Must
+   be called with lock held. */
+static void
+lStopWorkers() {
+    if (threads == NULL)
+        return;
+
+    shutdownRequested = 1;
+    lMemFence();
+    lAtomicAdd(&wakeSequence, 1);
+    syscall(SYS_futex, &wakeSequence, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    for (int i = 0; i < nThreads; ++i)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    threads = NULL;
+    lDestroyQueues();
+    shutdownRequested = 0;
+    lMemFence();
+}
+
+
+static inline void
+lAcquireInitLock() {
+    while (lAtomicCompareAndSwap32(&lock, 1, 0) != 0)
+        ;
+}
+
+
+static inline void
+lReleaseInitLock() {
+    // Make sure all of the above goes to memory before we clear the lock.
+    lMemFence();
+    lock = 0;
+}
+
+
+static void
+InitTaskSystem() {
+    if (threads == NULL) {
+        lAcquireInitLock();
+        if (threads == NULL) {
+            const char *pin = getenv("ISPC_PIN_THREADS");
+            lStartWorkers(lDefaultThreadCount(), pin != NULL && atoi(pin) != 0);
+        }
+        lReleaseInitLock();
+    }
+}
+
 #endif // ISPC_USE_PTHREADS
 
 ///////////////////////////////////////////////////////////////////////////
@@ -807,6 +1273,81 @@ FreeTaskGroup(TaskGroup *tg) {
     delete tg;
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Forwarding to an asst2 ITaskSystem
+
+#ifdef ISPC_USE_ITASKSYS
+
+static ITaskSystem *forwardTaskSystem = NULL;
+
+// Set while this thread runs a forwarded task.  ITaskSystem::sync() may
+// not be called from inside a task, so launches made by a forwarded task
+// run inline, on the calling thread.
+static __thread bool lInForwardedTask = false;
+
+
+/* Runs the tasks of one ISPC launch as the tasks of one ITaskSystem bulk
+   launch.  Like the GCD and ConcRT task systems, this passes placeholder
+   threadIndex/threadCount values, since ITaskSystem does not expose
+   which thread runs a task. */
+class LaunchRunnable : public IRunnable {
+public:
+    LaunchRunnable(TaskGroupBase *tg, int baseIndex)
+        : tg(tg), baseIndex(baseIndex) {}
+
+    void runTask(int taskId, int numTotalTasks) {
+        TaskInfo *ti = tg->GetTaskInfo(baseIndex + taskId);
+        bool wasInTask = lInForwardedTask;
+        lInForwardedTask = true;
+        ti->func(ti->data, 0, 1, ti->taskIndex, ti->taskCount);
+        lInForwardedTask = wasInTask;
+    }
+
+private:
+    TaskGroupBase *tg;
+    int baseIndex;
+};
+
+
+static void
+lForwardLaunch(TaskGroup *tg, int baseIndex, int count) {
+    // Nothing to run; a zero-task bulk launch may never finish
+    if (count <= 0)
+        return;
+
+    LaunchRunnable *runnable = new LaunchRunnable(tg, baseIndex);
+    if (lInForwardedTask) {
+        for (int i = 0; i < count; ++i)
+            runnable->runTask(i, count);
+        delete runnable;
+        return;
+    }
+    tg->forwardedLaunches.push_back(runnable);
+    tg->forwardTo->runAsyncWithDeps(runnable, count, std::vector<TaskID>());
+}
+
+
+/* Waits for the group's forwarded launches.  ITaskSystem::sync() waits
+   for everything launched on that task system, which includes this
+   group's launches and possibly others. */
+static void
+lForwardSync(TaskGroup *tg) {
+    if (tg->forwardedLaunches.size() == 0)
+        return;
+    tg->forwardTo->sync();
+    for (size_t i = 0; i < tg->forwardedLaunches.size(); ++i)
+        delete tg->forwardedLaunches[i];
+    tg->forwardedLaunches.clear();
+}
+
+
+void
+ISPCSetTaskSystem(ITaskSystem *taskSystem) {
+    forwardTaskSystem = taskSystem;
+}
+
+#endif // ISPC_USE_ITASKSYS
+
 ///////////////////////////////////////////////////////////////////////////
 
 // ispc expects these functions to have C linkage / not be mangled
@@ -816,16 +1357,30 @@ extern "C" {
     void ISPCSync(void *handle);
 }
 
-void
-ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count) {
+static inline TaskGroup *
+lGetTaskGroup(void **taskGroupPtr) {
+    if (*taskGroupPtr != NULL)
+        return (TaskGroup *)(*taskGroupPtr);
+
     TaskGroup *taskGroup;
-    if (*taskGroupPtr == NULL) {
+#ifdef ISPC_USE_ITASKSYS
+    ITaskSystem *forwardTo = forwardTaskSystem;
+    if (forwardTo == NULL)
         InitTaskSystem();
-        taskGroup = AllocTaskGroup();
-        *taskGroupPtr = taskGroup;
-    }
-    else
-        taskGroup = (TaskGroup *)(*taskGroupPtr);
+    taskGroup = AllocTaskGroup();
+    taskGroup->forwardTo = forwardTo;
+#else
+    InitTaskSystem();
+    taskGroup = AllocTaskGroup();
+#endif // ISPC_USE_ITASKSYS
+    *taskGroupPtr = taskGroup;
+    return taskGroup;
+}
+
+
+void
+ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count) {
+    TaskGroup *taskGroup = lGetTaskGroup(taskGroupPtr);
 
     int baseIndex = taskGroup->AllocTaskInfo(count);
     for (int i = 0; i < count; ++i) {
@@ -835,14 +1390,60 @@ ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count) {
         ti->taskIndex = i;
         ti->taskCount = count;
     }
+#ifdef ISPC_USE_ITASKSYS
+    if (taskGroup->forwardTo != NULL) {
+        lForwardLaunch(taskGroup, baseIndex, count);
+        return;
+    }
+#endif // ISPC_USE_ITASKSYS
     taskGroup->Launch(baseIndex, count);
 }
 
 
+void
+ISPCInitTaskSystem(int numThreads, int pinThreads) {
+#ifdef ISPC_USE_PTHREADS
+    lAcquireInitLock();
+    lStopWorkers();
+    lStartWorkers(numThreads > 0 ? numThreads : lDefaultThreadCount(),
+                  pinThreads != 0);
+    lReleaseInitLock();
+#else
+    InitTaskSystem();
+#endif // ISPC_USE_PTHREADS
+}
+
+
+void
+ISPCShutdownTaskSystem() {
+#ifdef ISPC_USE_PTHREADS
+    lAcquireInitLock();
+    lStopWorkers();
+    lReleaseInitLock();
+#endif // ISPC_USE_PTHREADS
+}
+
+
+int
+ISPCTaskSystemThreads() {
+#ifdef ISPC_USE_PTHREADS
+    InitTaskSystem();
+    return nThreads + 1;
+#else
+    return 0;
+#endif // ISPC_USE_PTHREADS
+}
+
+
 void
 ISPCSync(void *h) {
     TaskGroup *taskGroup = (TaskGroup *)h;
     if (taskGroup != NULL) {
+#ifdef ISPC_USE_ITASKSYS
+        if (taskGroup->forwardTo != NULL)
+            lForwardSync(taskGroup);
+        else
+#endif // ISPC_USE_ITASKSYS
         taskGroup->Sync();
         FreeTaskGroup(taskGroup);
     }
@@ -851,14 +1452,6 @@ ISPCSync(void *h) {
 
 void *
 ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment) {
-    TaskGroup *taskGroup;
-    if (*taskGroupPtr == NULL) {
-        InitTaskSystem();
-        taskGroup = AllocTaskGroup();
-        *taskGroupPtr = taskGroup;
-    }
-    else
-        taskGroup = (TaskGroup *)(*taskGroupPtr);
-
+    TaskGroup *taskGroup = lGetTaskGroup(taskGroupPtr);
     return taskGroup->AllocMemory(size, alignment);
 }
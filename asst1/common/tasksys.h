@@ -0,0 +1,45 @@
+#ifndef _ISPC_TASKSYS_H
+#define _ISPC_TASKSYS_H
+
+// Explicit control of the ISPC task system in tasksys.cpp.
+//
+// Without these calls the task system starts itself on the first launch
+// with ISPC_NUM_THREADS threads if that environment variable is set, or
+// else one thread per CPU the process may run on (its affinity mask,
+// capped by the cgroup CPU quota). Setting ISPC_PIN_THREADS=1 pins the
+// workers to CPUs. Thread counts include the thread that calls sync,
+// which runs tasks too.
+//
+// Only the pthreads task system (Linux) honors the thread count and
+// pinning; elsewhere these calls just make sure the system is started.
+
+extern "C" {
+
+// (Re)starts the task system with numThreads threads, or the default
+// count if numThreads <= 0. With pinThreads != 0, each worker is pinned
+// to its own CPU of the affinity mask. Must not be called while tasks
+// are running.
+void ISPCInitTaskSystem(int numThreads, int pinThreads);
+
+// Stops and joins all workers. Must not be called while tasks are
+// running. A later launch or ISPCInitTaskSystem() starts them again.
+void ISPCShutdownTaskSystem();
+
+// Number of threads the task system runs tasks on, starting it if
+// needed.
+int ISPCTaskSystemThreads();
+}
+
+#ifdef ISPC_USE_ITASKSYS
+class ITaskSystem;
+
+// Runs the launches of task groups created from now on as bulk launches
+// on taskSystem (an asst2 ITaskSystem, which must implement
+// runAsyncWithDeps() and sync()), or on the built-in task system again
+// if taskSystem is NULL. Launches made from inside a forwarded task run
+// inline on the calling thread. Must not be called while tasks are
+// running.
+void ISPCSetTaskSystem(ITaskSystem *taskSystem);
+#endif
+
+#endif
@@ -1,20 +1,61 @@
 #include <algorithm>
 #include <getopt.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
 #include "CycleTimer.h"
+#include "mandelPerturb.h"
+#include "mandelbrotSequence.h"
 
 extern void mandelbrotSerial(float x0, float y0, float x1, float y1, int width,
                              int height, int startRow, int numRows,
                              int maxIterations, int output[]);
 
+extern void mandelbrotSerialFast(float x0, float y0, float x1, float y1,
+                                 int width, int height, int startRow,
+                                 int numRows, int maxIterations, int output[]);
+
 extern void mandelbrotThread(int numThreads, float x0, float y0, float x1,
                              float y1, int width, int height, int maxIterations,
-                             int output[]);
+                             int output[], double busySeconds[], bool fast);
+
+extern void mandelbrotThreadDynamic(int numThreads, int tileSize, int order,
+                                    float x0, float y0, float x1, float y1,
+                                    int width, int height, int maxIterations,
+                                    int output[], double busySeconds[],
+                                    bool fast);
+
+extern long long mandelbrotThreadMariani(int numThreads, int tileSize, float x0,
+                                         float y0, float x1, float y1,
+                                         int width, int height,
+                                         int maxIterations, int output[],
+                                         bool fast);
+
+extern void mandelbrotSerialBand(float x0, float y0, float x1, float y1,
+                                 int width, int height, int startRow,
+                                 int numRows, int maxIterations, int output[],
+                                 bool fast);
+
+extern long long mandelbrotThreadPerturb(int numThreads, const double orbitRe[],
+                                         const double orbitIm[],
+                                         int orbitLength, double dx0,
+                                         double dy0, double pixelSize,
+                                         int width, int height,
+                                         int maxIterations, int output[]);
 
 extern void writePPMImage(int *data, int width, int height,
                           const char *filename, int maxIterations);
 
+typedef void (*RenderBandFunc)(void *context, int startRow, int numRows,
+                               int band[]);
+
+extern long long writePPMImageStreaming(const char *filename, int width,
+                                        int height, int maxIterations,
+                                        int numThreads, int bandRows,
+                                        RenderBandFunc renderBand,
+                                        void *context);
+
 void scaleAndShift(float &x0, float &x1, float &y0, float &y1, float scale,
                    float shiftX, float shiftY) {
 
@@ -32,7 +73,20 @@ void usage(const char *progname) {
   printf("Usage: %s [options]\n", progname);
   printf("Program Options:\n");
   printf("  -t  --threads <N>  Use N threads\n");
-  printf("  -v  --view <INT>   Use specified view settings\n");
+  printf("  -v  --view <INT>   Use specified view settings (3: deep zoom with\n");
+  printf("                     perturbation theory, %d iterations by default)\n",
+         kDeepMaxIterations);
+  printf("  -s  --schedule <S> Work distribution: static (default), or\n");
+  printf("                     dynamic tiles in row, morton or hilbert order\n");
+  printf("  -b  --tile <N>     Use NxN tiles for dynamic schedules (default 32)\n");
+  printf("  -f  --fast         Skip the set's interior (cardioid/bulb tests and\n");
+  printf("                     periodicity checks) in the threaded version\n");
+  printf("  -m  --mariani <N>  Also run the Mariani-Silver renderer on NxN tiles\n");
+  printf("  -i  --iterations <N> Iterate at most N times per pixel (default 256)\n");
+  printf("  -w  --stream <W>x<H> Only render a WxH image in bands straight to\n");
+  printf("                     mandelbrot-stream.ppm, with bounded memory\n");
+  printf("  -z  --sequence <N> Only render N frames of a pan/zoom sequence,\n");
+  printf("                     incrementally and from scratch\n");
   printf("  -?  --help         This message\n");
 }
 
@@ -53,12 +107,225 @@ bool verifyResult(int *gold, int *result, int width, int height) {
   return 1;
 }
 
+//
+// printBusyTimes --
+//
+// Prints how long the threads computed. max / mean is 1 when the work
+// is perfectly balanced.
+void printBusyTimes(const std::vector<double> &busySeconds) {
+  double minBusy = 1e30, maxBusy = 0, sumBusy = 0;
+  for (double t : busySeconds) {
+    minBusy = std::min(minBusy, t);
+    maxBusy = std::max(maxBusy, t);
+    sumBusy += t;
+  }
+  double meanBusy = sumBusy / busySeconds.size();
+
+  printf("[thread busy time]:\t\tmin %.3f ms, mean %.3f ms, max %.3f ms "
+         "(imbalance %.2fx)\n",
+         minBusy * 1000, meanBusy * 1000, maxBusy * 1000,
+         meanBusy > 0 ? maxBusy / meanBusy : 1.0);
+  for (size_t i = 0; i < busySeconds.size(); i++)
+    printf("\t\t\t\tthread %2d: %.3f ms\n", (int)i, busySeconds[i] * 1000);
+}
+
+//
+// timeWritePPM --
+//
+// Writes the image like writePPMImage and prints how long that took
+// compared with renderSeconds, the time it took to compute the image.
+void timeWritePPM(int *data, int width, int height, const char *filename,
+                  int maxIterations, double renderSeconds) {
+  double startTime = CycleTimer::currentSeconds();
+  writePPMImage(data, width, height, filename, maxIterations);
+  double endTime = CycleTimer::currentSeconds();
+  printf("[write ppm]:\t\t\t[%.3f] ms (%.2fx of the render time)\n",
+         (endTime - startTime) * 1000, (endTime - startTime) / renderSeconds);
+}
+
+typedef struct {
+  float x0, y0, x1, y1;
+  int width, height;
+  int maxIterations;
+  bool fast;
+} StreamArgs;
+
+void renderStreamBand(void *context, int startRow, int numRows, int band[]) {
+  StreamArgs *a = (StreamArgs *)context;
+  mandelbrotSerialBand(a->x0, a->y0, a->x1, a->y1, a->width, a->height,
+                       startRow, numRows, a->maxIterations, band, a->fast);
+}
+
+//
+// renderStreaming --
+//
+// Renders a streamWidth x streamHeight image of the view in bands of
+// about 1M pixels, on numThreads threads, without ever holding the whole
+// image in memory.
+int renderStreaming(int numThreads, int streamWidth, int streamHeight,
+                    float x0, float y0, float x1, float y1, int maxIterations,
+                    bool fast) {
+  StreamArgs args = {x0,          y0,           x1,            y1,
+                     streamWidth, streamHeight, maxIterations, fast};
+  int bandRows = std::max(1, (1 << 20) / streamWidth);
+
+  double startTime = CycleTimer::currentSeconds();
+  long long bufferBytes = writePPMImageStreaming(
+      "mandelbrot-stream.ppm", streamWidth, streamHeight, maxIterations,
+      numThreads, bandRows, renderStreamBand, &args);
+  double endTime = CycleTimer::currentSeconds();
+  if (bufferBytes < 0)
+    return 1;
+
+  double pixels = (double)streamWidth * streamHeight;
+  printf("[mandelbrot stream %dx%d]:\t[%.3f] ms (%.1f Mpixels/s, %.1f MB of "
+         "band buffers for a %.1f MB image)\n",
+         streamWidth, streamHeight, (endTime - startTime) * 1000,
+         pixels / (endTime - startTime) / 1e6, bufferBytes / 1e6,
+         pixels * 3 / 1e6);
+  return 0;
+}
+
+//
+// renderSequence --
+//
+// Renders numFrames frames that alternately pan right by 1/8 of the
+// width and zoom in 2x around the center, once with MandelbrotSequence
+// and once from scratch with mandelbrotThread, and compares the two.
+// The viewport starts on a grid of 1/512 so that both keep pixel
+// coordinates exact (for about 14 zooms).
+int renderSequence(int numThreads, int width, int height, int maxIterations,
+                   int numFrames, bool fast) {
+  float pixelSize = 1.f / 512;
+  float x0 = -2.25f, y0 = -pixelSize * (height / 2);
+
+  MandelbrotSequence sequence(width, height, maxIterations, numThreads, fast);
+  std::vector<int> scratch((size_t)width * height);
+  double totalIncremental = 0, totalScratch = 0;
+  long long totalReused = 0;
+
+  for (int f = 0; f < numFrames; f++) {
+    if (f > 0 && f % 2 == 1) {
+      x0 += pixelSize * (width / 8);
+    } else if (f > 0) {
+      x0 += pixelSize * (width / 4);
+      y0 += pixelSize * (height / 4);
+      pixelSize /= 2;
+    }
+    float x1 = x0 + pixelSize * width, y1 = y0 + pixelSize * height;
+
+    double startTime = CycleTimer::currentSeconds();
+    const int *frame = sequence.renderFrame(x0, y0, x1, y1);
+    double midTime = CycleTimer::currentSeconds();
+    mandelbrotThread(numThreads, x0, y0, x1, y1, width, height, maxIterations,
+                     scratch.data(), NULL, fast);
+    double endTime = CycleTimer::currentSeconds();
+
+    if (!verifyResult(scratch.data(), (int *)frame, width, height)) {
+      printf("Error : Frame %d differs from a full render\n", f);
+      return 1;
+    }
+    printf("[frame %2d %s]:\t\t[%.3f] ms vs [%.3f] ms from scratch "
+           "(%.1f%% reused)\n",
+           f, f == 0 ? "start" : f % 2 ? "pan  " : "zoom ",
+           (midTime - startTime) * 1000, (endTime - midTime) * 1000,
+           100.0 * sequence.reusedPixels() / ((double)width * height));
+    totalIncremental += midTime - startTime;
+    totalScratch += endTime - midTime;
+    totalReused += sequence.reusedPixels();
+  }
+
+  printf("[mandelbrot sequence]:\t\t[%.3f] ms vs [%.3f] ms from scratch "
+         "(%.1f%% reused)\n",
+         totalIncremental * 1000, totalScratch * 1000,
+         100.0 * totalReused / ((double)width * height * numFrames));
+  printf("\t\t\t\t(%.2fx speedup from reusing frames)\n",
+         totalScratch / totalIncremental);
+  return 0;
+}
+
+//
+// renderDeep --
+//
+// Renders the deep zoom of view 3 with perturbation theory on
+// numThreads threads. Float and double cannot resolve its pixels, so
+// the result is checked against brute-force __float128 iteration on a
+// sample of pixels, which also estimates how long a full brute-force
+// render would take.
+int renderDeep(int numThreads, int width, int height, int maxIterations) {
+  std::vector<double> orbitRe, orbitIm;
+  double startTime = CycleTimer::currentSeconds();
+  mandelReferenceOrbit(kDeepCenterRe, kDeepCenterIm, maxIterations, orbitRe,
+                       orbitIm);
+  double orbitTime = CycleTimer::currentSeconds() - startTime;
+
+  double pixelSize = kDeepWidth / width;
+  double dx0 = -pixelSize * (width / 2), dy0 = -pixelSize * (height / 2);
+  std::vector<int> output((size_t)width * height);
+
+  // Deep zooms take long enough to time a single run
+  startTime = CycleTimer::currentSeconds();
+  long long rebases = mandelbrotThreadPerturb(
+      numThreads, orbitRe.data(), orbitIm.data(), orbitRe.size(), dx0, dy0,
+      pixelSize, width, height, maxIterations, output.data());
+  double minPerturb = CycleTimer::currentSeconds() - startTime;
+
+  printf("[reference orbit]:\t\t[%.3f] ms (%d elements)\n", orbitTime * 1000,
+         (int)orbitRe.size());
+  printf("[mandelbrot perturbation]:\t[%.3f] ms (%lld rebases)\n",
+         minPerturb * 1000, rebases);
+  writePPMImage(output.data(), width, height, "mandelbrot-deep.ppm",
+                maxIterations);
+
+  // Check about 1000 pixels spread over the image
+  const int numSamples = 1000;
+  size_t numPixels = (size_t)width * height;
+  int agree = 0;
+  double quadTime = 0;
+  for (int s = 0; s < numSamples; s++) {
+    size_t p = s * (numPixels / numSamples) + s % width;
+    if (p >= numPixels)
+      p = numPixels - 1;
+    int i = p % width, j = p / width;
+    double startTime = CycleTimer::currentSeconds();
+    int count = mandelQuad(kDeepCenterRe, kDeepCenterIm, dx0 + i * pixelSize,
+                           dy0 + j * pixelSize, maxIterations);
+    quadTime += CycleTimer::currentSeconds() - startTime;
+    agree += count == output[p];
+  }
+
+  printf("[__float128 check]:\t\t%d of %d sampled pixels agree\n", agree,
+         numSamples);
+  printf("\t\t\t\t(%.2fx speedup over %d-thread __float128, estimated)\n",
+         quadTime * numPixels / numSamples / numThreads / minPerturb,
+         numThreads);
+
+  // Perturbation in double can flip the count of the odd pixel whose
+  // orbit comes within rounding of escaping
+  if (agree < numSamples * 99 / 100) {
+    printf("Error : Perturbation output differs from __float128 output\n");
+    return 1;
+  }
+  return 0;
+}
+
 int main(int argc, char **argv) {
 
   const unsigned int width = 1600;
   const unsigned int height = 1200;
-  const int maxIterations = 256;
+  int maxIterations = 256;
   int numThreads = 8;
+  int tileSize = 32;
+  // -1 for the static schedule, else a tile order of
+  // mandelbrotThreadDynamic: 0 row, 1 morton, 2 hilbert.
+  int tileOrder = -1;
+  const char *scheduleNames[] = {"row", "morton", "hilbert"};
+  bool fast = false;
+  int marianiTileSize = 0; // 0 to skip the Mariani-Silver renderer
+  int streamWidth = 0, streamHeight = 0; // 0 for the usual runs
+  bool deepView = false;
+  bool iterationsSet = false;
+  int sequenceFrames = 0;                // 0 for the usual runs
 
   float x0 = -2;
   float x1 = 1;
@@ -69,10 +336,17 @@ int main(int argc, char **argv) {
   int opt;
   static struct option long_options[] = {{"threads", 1, 0, 't'},
                                          {"view", 1, 0, 'v'},
+                                         {"schedule", 1, 0, 's'},
+                                         {"tile", 1, 0, 'b'},
+                                         {"fast", 0, 0, 'f'},
+                                         {"mariani", 1, 0, 'm'},
+                                         {"iterations", 1, 0, 'i'},
+                                         {"stream", 1, 0, 'w'},
+                                         {"sequence", 1, 0, 'z'},
                                          {"help", 0, 0, '?'},
                                          {0, 0, 0, 0}};
 
-  while ((opt = getopt_long(argc, argv, "t:v:?", long_options, NULL)) != EOF) {
+  while ((opt = getopt_long(argc, argv, "t:v:s:b:fm:i:w:z:?", long_options, NULL)) != EOF) {
 
     switch (opt) {
     case 't': {
@@ -87,12 +361,72 @@ int main(int argc, char **argv) {
         float shiftX = -.986f;
         float shiftY = .30f;
         scaleAndShift(x0, x1, y0, y1, scaleValue, shiftX, shiftY);
+      } else if (viewIndex == 3) {
+        deepView = true;
       } else if (viewIndex > 1) {
         fprintf(stderr, "Invalid view index\n");
         return 1;
       }
       break;
     }
+    case 's': {
+      tileOrder = -2;
+      if (strcmp(optarg, "static") == 0)
+        tileOrder = -1;
+      for (int i = 0; i < 3; i++) {
+        if (strcmp(optarg, scheduleNames[i]) == 0)
+          tileOrder = i;
+      }
+      if (tileOrder == -2) {
+        fprintf(stderr, "Invalid schedule %s\n", optarg);
+        return 1;
+      }
+      break;
+    }
+    case 'b': {
+      tileSize = atoi(optarg);
+      if (tileSize < 1) {
+        fprintf(stderr, "Invalid tile size\n");
+        return 1;
+      }
+      break;
+    }
+    case 'f':
+      fast = true;
+      break;
+    case 'm': {
+      marianiTileSize = atoi(optarg);
+      if (marianiTileSize < 1) {
+        fprintf(stderr, "Invalid tile size\n");
+        return 1;
+      }
+      break;
+    }
+    case 'i': {
+      maxIterations = atoi(optarg);
+      iterationsSet = true;
+      if (maxIterations < 1) {
+        fprintf(stderr, "Invalid iteration count\n");
+        return 1;
+      }
+      break;
+    }
+    case 'w': {
+      if (sscanf(optarg, "%dx%d", &streamWidth, &streamHeight) != 2 ||
+          streamWidth < 1 || streamHeight < 1) {
+        fprintf(stderr, "Invalid image size %s\n", optarg);
+        return 1;
+      }
+      break;
+    }
+    case 'z': {
+      sequenceFrames = atoi(optarg);
+      if (sequenceFrames < 1) {
+        fprintf(stderr, "Invalid frame count\n");
+        return 1;
+      }
+      break;
+    }
     case '?':
     default:
       usage(argv[0]);
@@ -101,6 +435,21 @@ int main(int argc, char **argv) {
   }
   // end parsing of commandline options
 
+  if (numThreads < 1) {
+    fprintf(stderr, "Invalid thread count\n");
+    return 1;
+  }
+
+  if (deepView)
+    return renderDeep(numThreads, width, height,
+                      iterationsSet ? maxIterations : kDeepMaxIterations);
+  if (streamWidth > 0)
+    return renderStreaming(numThreads, streamWidth, streamHeight, x0, y0, x1,
+                           y1, maxIterations, fast);
+  if (sequenceFrames > 0)
+    return renderSequence(numThreads, width, height, maxIterations,
+                          sequenceFrames, fast);
+
   int *output_serial = new int[width * height];
   int *output_thread = new int[width * height];
 
@@ -120,26 +469,69 @@ int main(int argc, char **argv) {
   }
 
   printf("[mandelbrot serial]:\t\t[%.3f] ms\n", minSerial * 1000);
-  writePPMImage(output_serial, width, height, "mandelbrot-serial.ppm",
-                maxIterations);
+  timeWritePPM(output_serial, width, height, "mandelbrot-serial.ppm",
+               maxIterations, minSerial);
+
+  // the threads are compared to the serial run with the same shortcuts
+  double minSerialFast = minSerial;
+  if (fast) {
+    //
+    // Run the serial implementation with the interior shortcuts
+    //
+    minSerialFast = 1e30;
+    for (int i = 0; i < 5; ++i) {
+      memset(output_thread, 0, width * height * sizeof(int));
+      double startTime = CycleTimer::currentSeconds();
+      mandelbrotSerialFast(x0, y0, x1, y1, width, height, 0, height,
+                           maxIterations, output_thread);
+      double endTime = CycleTimer::currentSeconds();
+      minSerialFast = std::min(minSerialFast, endTime - startTime);
+    }
+
+    printf("[mandelbrot serial fast]:\t[%.3f] ms\n", minSerialFast * 1000);
+    if (!verifyResult(output_serial, output_thread, width, height)) {
+      printf("Error : Fast serial output does not match serial output\n");
+
+      delete[] output_serial;
+      delete[] output_thread;
+
+      return 1;
+    }
+    printf("\t\t\t\t(%.2fx speedup from interior shortcuts)\n",
+           minSerial / minSerialFast);
+  }
 
   //
   // Run the threaded version
   //
 
   double minThread = 1e30;
+  std::vector<double> busySeconds(numThreads), bestBusySeconds(numThreads);
   for (int i = 0; i < 5; ++i) {
     memset(output_thread, 0, width * height * sizeof(int));
     double startTime = CycleTimer::currentSeconds();
-    mandelbrotThread(numThreads, x0, y0, x1, y1, width, height, maxIterations,
-                     output_thread);
+    if (tileOrder < 0)
+      mandelbrotThread(numThreads, x0, y0, x1, y1, width, height,
+                       maxIterations, output_thread, busySeconds.data(), fast);
+    else
+      mandelbrotThreadDynamic(numThreads, tileSize, tileOrder, x0, y0, x1, y1,
+                              width, height, maxIterations, output_thread,
+                              busySeconds.data(), fast);
     double endTime = CycleTimer::currentSeconds();
-    minThread = std::min(minThread, endTime - startTime);
+    if (endTime - startTime < minThread) {
+      minThread = endTime - startTime;
+      bestBusySeconds = busySeconds;
+    }
   }
 
-  printf("[mandelbrot thread]:\t\t[%.3f] ms\n", minThread * 1000);
-  writePPMImage(output_thread, width, height, "mandelbrot-thread.ppm",
-                maxIterations);
+  if (tileOrder < 0)
+    printf("[mandelbrot thread]:\t\t[%.3f] ms\n", minThread * 1000);
+  else
+    printf("[mandelbrot thread %s %dx%d]:\t[%.3f] ms\n",
+           scheduleNames[tileOrder], tileSize, tileSize, minThread * 1000);
+  printBusyTimes(bestBusySeconds);
+  timeWritePPM(output_thread, width, height, "mandelbrot-thread.ppm",
+               maxIterations, minThread);
 
   if (!verifyResult(output_serial, output_thread, width, height)) {
     printf("Error : Output from threads does not match serial output\n");
@@ -151,8 +543,45 @@ int main(int argc, char **argv) {
   }
 
   // compute speedup
-  printf("\t\t\t\t(%.2fx speedup from %d threads)\n", minSerial / minThread,
-         numThreads);
+  printf("\t\t\t\t(%.2fx speedup from %d threads)\n",
+         minSerialFast / minThread, numThreads);
+  if (fast)
+    printf("\t\t\t\t(%.2fx speedup over serial without shortcuts)\n",
+           minSerial / minThread);
+
+  if (marianiTileSize > 0) {
+    //
+    // Run the Mariani-Silver renderer on as many threads
+    //
+    double minMariani = 1e30;
+    long long computed = 0;
+    for (int i = 0; i < 5; ++i) {
+      memset(output_thread, 0, width * height * sizeof(int));
+      double startTime = CycleTimer::currentSeconds();
+      computed = mandelbrotThreadMariani(numThreads, marianiTileSize, x0, y0,
+                                         x1, y1, width, height, maxIterations,
+                                         output_thread, fast);
+      double endTime = CycleTimer::currentSeconds();
+      minMariani = std::min(minMariani, endTime - startTime);
+    }
+
+    printf("[mandelbrot mariani-silver]:\t[%.3f] ms (%.1f%% of pixels "
+           "iterated)\n",
+           minMariani * 1000, 100.0 * computed / ((double)width * height));
+    writePPMImage(output_thread, width, height, "mandelbrot-mariani.ppm",
+                  maxIterations);
+
+    if (!verifyResult(output_serial, output_thread, width, height)) {
+      printf("Error : Mariani-Silver output does not match serial output\n");
+
+      delete[] output_serial;
+      delete[] output_thread;
+
+      return 1;
+    }
+    printf("\t\t\t\t(%.2fx speedup over the brute-force threads)\n",
+           minThread / minMariani);
+  }
 
   delete[] output_serial;
   delete[] output_thread;
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "mandelFast.h"
+
+extern void mandelbrotSerialTile(float x0, float y0, float x1, float y1,
+                                 int width, int height, int startCol,
+                                 int startRow, int tileWidth, int tileHeight,
+                                 int maxIterations, int output[], bool fast);
+
+//
+// Mariani-Silver renderer. A rectangle whose border pixels all have the
+// same iteration count is filled with that count; otherwise it is split
+// in two along its longer side and both halves are handled the same
+// way. Rectangles whose interior is at most MIN_INTERIOR pixels wide are
+// computed in full.
+//
+// The fill relies on the points with more (or fewer) iterations than a
+// given escape count forming a connected set, which cannot hide inside a
+// border of that count. That only holds for a continuous border: the
+// border here is sampled at pixel centres, and a filament thinner than a
+// pixel can cross it unseen. Float rounding also lets isolated pixels
+// near the boundary of the set escape, so a border of maxIterations only
+// fills the pixels that mandelInterior() proves to be inside the set;
+// the others are computed. The output is therefore not guaranteed to
+// match mandelbrotSerial, and main.cpp checks it against the serial
+// output on every run.
+//
+
+typedef struct {
+  float x0, y0, x1, y1;
+  int width, height;
+  int maxIterations;
+  int *output;
+  bool fast;
+  long long computed; // pixels iterated rather than filled
+} MarianiArgs;
+
+static const int MIN_INTERIOR = 4;
+
+static void computePixels(MarianiArgs &a, int col, int row, int w, int h) {
+  if (w <= 0 || h <= 0)
+    return;
+  mandelbrotSerialTile(a.x0, a.y0, a.x1, a.y1, a.width, a.height, col, row, w,
+                       h, a.maxIterations, a.output, a.fast);
+  a.computed += (long long)w * h;
+}
+
+//
+// subdivide --
+//
+// Fills the interior of the rectangle with corners (c0, r0) and
+// (c1, r1), inclusive, whose border has already been computed.
+static void subdivide(MarianiArgs &a, int c0, int r0, int c1, int r1) {
+  int innerW = c1 - c0 - 1, innerH = r1 - r0 - 1;
+  if (innerW <= 0 || innerH <= 0)
+    return;
+
+  int *out = a.output;
+  int w = a.width;
+  int value = out[r0 * w + c0];
+  bool uniform = true;
+  for (int i = c0; i <= c1 && uniform; i++)
+    uniform = out[r0 * w + i] == value && out[r1 * w + i] == value;
+  for (int j = r0 + 1; j < r1 && uniform; j++)
+    uniform = out[j * w + c0] == value && out[j * w + c1] == value;
+
+  if (uniform && value < a.maxIterations) {
+    for (int j = r0 + 1; j < r1; j++)
+      std::fill(out + j * w + c0 + 1, out + j * w + c1, value);
+    return;
+  }
+
+  if (uniform) {
+    float dx = (a.x1 - a.x0) / a.width;
+    float dy = (a.y1 - a.y0) / a.height;
+    for (int j = r0 + 1; j < r1; j++) {
+      for (int i = c0 + 1; i < c1; i++) {
+        if (mandelInterior(a.x0 + i * dx, a.y0 + j * dy))
+          out[j * w + i] = value;
+        else
+          computePixels(a, i, j, 1, 1);
+      }
+    }
+    return;
+  }
+
+  if (innerW <= MIN_INTERIOR && innerH <= MIN_INTERIOR) {
+    computePixels(a, c0 + 1, r0 + 1, innerW, innerH);
+    return;
+  }
+
+  if (innerW >= innerH) {
+    int mid = (c0 + c1) / 2;
+    computePixels(a, mid, r0 + 1, 1, innerH);
+    subdivide(a, c0, r0, mid, r1);
+    subdivide(a, mid, r0, c1, r1);
+  } else {
+    int mid = (r0 + r1) / 2;
+    computePixels(a, c0 + 1, mid, innerW, 1);
+    subdivide(a, c0, r0, c1, mid);
+    subdivide(a, c0, mid, c1, r1);
+  }
+}
+
+//
+// renderTile --
+//
+// Computes the border of a tile and fills in the rest.
+static void renderTile(MarianiArgs &a, int col, int row, int tileWidth,
+                       int tileHeight) {
+  int c1 = std::min(col + tileWidth, a.width) - 1;
+  int r1 = std::min(row + tileHeight, a.height) - 1;
+
+  computePixels(a, col, row, c1 - col + 1, 1);
+  if (r1 > row)
+    computePixels(a, col, r1, c1 - col + 1, 1);
+  computePixels(a, col, row + 1, 1, r1 - row - 1);
+  if (c1 > col)
+    computePixels(a, c1, row + 1, 1, r1 - row - 1);
+
+  subdivide(a, col, row, c1, r1);
+}
+
+//
+// MandelbrotThreadMariani --
+//
+// Multi-threaded Mariani-Silver renderer. numThreads threads claim
+// tileSize x tileSize tiles from a shared counter and render each with
+// the subdivision above (with mandelFast() if fast is set). Returns the
+// number of pixels that were iterated; the others were filled.
+long long mandelbrotThreadMariani(int numThreads, int tileSize, float x0,
+                                  float y0, float x1, float y1, int width,
+                                  int height, int maxIterations, int output[],
+                                  bool fast) {
+  if (numThreads < 1 || tileSize < 1) {
+    fprintf(stderr, "Error: Need at least one thread and a tile size >= 1\n");
+    exit(1);
+  }
+
+  int tilesX = (width + tileSize - 1) / tileSize;
+  int tilesY = (height + tileSize - 1) / tileSize;
+  std::atomic<int> nextTile(0);
+
+  std::vector<MarianiArgs> args(numThreads);
+  for (int i = 0; i < numThreads; i++)
+    args[i] = {x0, y0, x1, y1, width, height, maxIterations, output, fast, 0};
+
+  auto worker = [&](int threadId) {
+    int tile;
+    while ((tile = nextTile.fetch_add(1, std::memory_order_relaxed)) <
+           tilesX * tilesY) {
+      renderTile(args[threadId], (tile % tilesX) * tileSize,
+                 (tile / tilesX) * tileSize, tileSize, tileSize);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < numThreads; i++)
+    workers.push_back(std::thread(worker, i));
+  worker(0);
+  for (auto &t : workers)
+    t.join();
+
+  long long computed = 0;
+  for (int i = 0; i < numThreads; i++)
+    computed += args[i].computed;
+  return computed;
+}
@@ -0,0 +1,45 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "mandelPerturb.h"
+
+//
+// MandelbrotThreadPerturb --
+//
+// Deep-zoom rendering with perturbation theory (see mandelPerturb.h).
+// Pixel (i, j) is c = C + (dx0 + i * pixelSize) + (dy0 + j * pixelSize) i,
+// where C is the center of the reference orbit. numThreads threads claim
+// rows from a shared counter. Returns the number of rebases.
+long long mandelbrotThreadPerturb(int numThreads, const double orbitRe[],
+                                  const double orbitIm[], int orbitLength,
+                                  double dx0, double dy0, double pixelSize,
+                                  int width, int height, int maxIterations,
+                                  int output[]) {
+  std::atomic<int> nextRow(0);
+  std::atomic<long long> rebases(0);
+
+  auto worker = [&]() {
+    int j;
+    while ((j = nextRow.fetch_add(1, std::memory_order_relaxed)) < height) {
+      int rowRebases = 0;
+      double dc_im = dy0 + j * pixelSize;
+      for (int i = 0; i < width; i++) {
+        double dc_re = dx0 + i * pixelSize;
+        output[(size_t)j * width + i] =
+            mandelPerturb(dc_re, dc_im, orbitRe, orbitIm, orbitLength,
+                          maxIterations, &rowRebases);
+      }
+      rebases += rowRebases;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < numThreads; i++)
+    workers.push_back(std::thread(worker));
+  worker();
+  for (auto &t : workers)
+    t.join();
+
+  return rebases;
+}
@@ -0,0 +1,108 @@
+#include <atomic>
+#include <thread>
+
+#include "mandelbrotSequence.h"
+
+extern void mandelbrotSerialTile(float x0, float y0, float x1, float y1,
+                                 int width, int height, int startCol,
+                                 int startRow, int tileWidth, int tileHeight,
+                                 int maxIterations, int output[], bool fast);
+
+//
+// pixelCoordinates --
+//
+// Coordinates of the n pixels of a row or column, computed exactly like
+// the kernels do.
+static std::vector<float> pixelCoordinates(float v0, float v1, int n) {
+  float d = (v1 - v0) / n;
+  std::vector<float> v(n);
+  for (int i = 0; i < n; i++)
+    v[i] = v0 + i * d;
+  return v;
+}
+
+//
+// matchCoordinates --
+//
+// For each of the increasing coordinates cur, the index of the equal
+// coordinate in the increasing prev, or -1.
+static std::vector<int> matchCoordinates(const std::vector<float> &cur,
+                                         const std::vector<float> &prev) {
+  std::vector<int> match(cur.size(), -1);
+  size_t k = 0;
+  for (size_t i = 0; i < cur.size(); i++) {
+    while (k < prev.size() && prev[k] < cur[i])
+      k++;
+    if (k < prev.size() && prev[k] == cur[i])
+      match[i] = k;
+  }
+  return match;
+}
+
+MandelbrotSequence::MandelbrotSequence(int width, int height,
+                                       int maxIterations, int numThreads,
+                                       bool fast)
+    : width_(width), height_(height), maxIterations_(maxIterations),
+      numThreads_(numThreads < 1 ? 1 : numThreads), fast_(fast),
+      frame_((size_t)width * height), prev_((size_t)width * height),
+      reused_(0) {}
+
+const int *MandelbrotSequence::renderFrame(float x0, float y0, float x1,
+                                           float y1) {
+  std::vector<float> xs = pixelCoordinates(x0, x1, width_);
+  std::vector<float> ys = pixelCoordinates(y0, y1, height_);
+
+  std::vector<int> colMatch(width_, -1), rowMatch(height_, -1);
+  if (!prevX_.empty()) {
+    colMatch = matchCoordinates(xs, prevX_);
+    rowMatch = matchCoordinates(ys, prevY_);
+  }
+  frame_.swap(prev_);
+
+  // Threads claim rows; a row is copied where its columns match and
+  // computed in runs of unmatched pixels elsewhere.
+  std::atomic<int> nextRow(0);
+  std::atomic<long long> reused(0);
+  auto worker = [&]() {
+    long long pixelsReused = 0;
+    int j;
+    while ((j = nextRow.fetch_add(1, std::memory_order_relaxed)) < height_) {
+      int *out = frame_.data() + (size_t)j * width_;
+      if (rowMatch[j] < 0) {
+        mandelbrotSerialTile(x0, y0, x1, y1, width_, height_, 0, j, width_, 1,
+                             maxIterations_, frame_.data(), fast_);
+        continue;
+      }
+
+      const int *in = prev_.data() + (size_t)rowMatch[j] * width_;
+      int i = 0;
+      while (i < width_) {
+        if (colMatch[i] >= 0) {
+          out[i] = in[colMatch[i]];
+          pixelsReused++;
+          i++;
+          continue;
+        }
+        int start = i;
+        while (i < width_ && colMatch[i] < 0)
+          i++;
+        mandelbrotSerialTile(x0, y0, x1, y1, width_, height_, start, j,
+                             i - start, 1, maxIterations_, frame_.data(),
+                             fast_);
+      }
+    }
+    reused += pixelsReused;
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < numThreads_; i++)
+    workers.push_back(std::thread(worker));
+  worker();
+  for (auto &t : workers)
+    t.join();
+
+  reused_ = reused;
+  prevX_.swap(xs);
+  prevY_.swap(ys);
+  return frame_.data();
+}
@@ -0,0 +1,46 @@
+#ifndef _MANDELBROT_SEQUENCE_H
+#define _MANDELBROT_SEQUENCE_H
+
+#include <vector>
+
+//
+// MandelbrotSequence --
+//
+// Renders the frames of a pan/zoom sequence, reusing the previous frame.
+// A pixel's iteration count only depends on its float coordinates, so
+// every pixel whose column x and row y both equal (bit for bit) those of
+// some pixel of the previous frame is copied from it. Only the other
+// pixels are computed, on numThreads threads, and every frame is
+// identical to one rendered from scratch.
+//
+// How much is reused depends on the coordinates coinciding exactly:
+// panning by whole pixels and 2x zooms do on viewports whose corners
+// and pixel size are multiples of a power of two, but seldom otherwise.
+//
+class MandelbrotSequence {
+public:
+  MandelbrotSequence(int width, int height, int maxIterations, int numThreads,
+                     bool fast);
+
+  // Renders the frame of viewport (x0, y0) - (x1, y1). The returned
+  // buffer is valid until the next call.
+  const int *renderFrame(float x0, float y0, float x1, float y1);
+
+  // Number of pixels of the last frame copied from the one before.
+  long long reusedPixels() const { return reused_; }
+
+  // Forgets the previous frame, so the next one is rendered in full.
+  void reset() { prevX_.clear(); }
+
+private:
+  int width_, height_;
+  int maxIterations_;
+  int numThreads_;
+  bool fast_;
+
+  std::vector<int> frame_, prev_;
+  std::vector<float> prevX_, prevY_; // pixel coordinates of prev_
+  long long reused_;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#include <algorithm>
+
+#include "mandelFast.h"
 
 static inline int mandel(float c_re, float c_im, int count) {
   float z_re = c_re, z_im = c_im;
@@ -46,9 +49,33 @@ void mandelbrotSerial(float x0, float y0, float x1, float y1, int width,
   }
 }
 
+//
+// MandelbrotSerialFast --
+//
+// Same as mandelbrotSerial, with the interior shortcuts of mandelFast().
+// The output is identical.
+void mandelbrotSerialFast(float x0, float y0, float x1, float y1, int width,
+                          int height, int startRow, int totalRows,
+                          int maxIterations, int output[]) {
+  float dx = (x1 - x0) / width;
+  float dy = (y1 - y0) / height;
+
+  int endRow = startRow + totalRows;
+
+  for (int j = startRow; j < endRow; j++) {
+    for (int i = 0; i < width; ++i) {
+      float x = x0 + i * dx;
+      float y = y0 + j * dy;
+
+      int index = (j * width + i);
+      output[index] = mandelFast(x, y, maxIterations);
+    }
+  }
+}
+
 void mandelbrotSerial2(float x0, float y0, float x1, float y1, int width,
                        int height, int startRow, int numThreads,
-                       int maxIterations, int output[]) {
+                       int maxIterations, int output[], bool fast) {
   float dx = (x1 - x0) / width;
   float dy = (y1 - y0) / height;
 
@@ -58,7 +85,62 @@ void mandelbrotSerial2(float x0, float y0, float x1, float y1, int width,
       float y = y0 + j * dy;
 
       int index = (j * width + i);
-      output[index] = mandel(x, y, maxIterations);
+      output[index] =
+          fast ? mandelFast(x, y, maxIterations) : mandel(x, y, maxIterations);
+    }
+  }
+}
+
+//
+// MandelbrotSerialTile --
+//
+// Same as mandelbrotSerial, for the tileWidth x tileHeight block of
+// pixels whose top left corner is (startCol, startRow). The tile is
+// clipped to the image. With fast set, mandelFast() is used instead of
+// mandel().
+void mandelbrotSerialTile(float x0, float y0, float x1, float y1, int width,
+                          int height, int startCol, int startRow,
+                          int tileWidth, int tileHeight, int maxIterations,
+                          int output[], bool fast) {
+  float dx = (x1 - x0) / width;
+  float dy = (y1 - y0) / height;
+
+  int endRow = std::min(startRow + tileHeight, height);
+  int endCol = std::min(startCol + tileWidth, width);
+
+  for (int j = startRow; j < endRow; j++) {
+    for (int i = startCol; i < endCol; ++i) {
+      float x = x0 + i * dx;
+      float y = y0 + j * dy;
+
+      int index = (j * width + i);
+      output[index] =
+          fast ? mandelFast(x, y, maxIterations) : mandel(x, y, maxIterations);
+    }
+  }
+}
+
+//
+// MandelbrotSerialBand --
+//
+// Same as mandelbrotSerial, but writes rows startRow ..
+// startRow + numRows - 1 to the start of output, for rendering images
+// in bands that would not fit in memory as a whole.
+void mandelbrotSerialBand(float x0, float y0, float x1, float y1, int width,
+                          int height, int startRow, int numRows,
+                          int maxIterations, int output[], bool fast) {
+  float dx = (x1 - x0) / width;
+  float dy = (y1 - y0) / height;
+
+  for (int r = 0; r < numRows; r++) {
+    int j = startRow + r;
+    int *row = output + (size_t)r * width;
+    for (int i = 0; i < width; ++i) {
+      float x = x0 + i * dx;
+      float y = y0 + j * dy;
+
+      row[i] =
+          fast ? mandelFast(x, y, maxIterations) : mandel(x, y, maxIterations);
     }
   }
 }
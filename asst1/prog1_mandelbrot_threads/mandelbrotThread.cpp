@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <atomic>
 #include <stdio.h>
 #include <thread>
+#include <vector>
 
 #include "CycleTimer.h"
 
@@ -12,21 +15,40 @@ typedef struct {
   int *output;
   int threadId;
   int numThreads;
+  bool fast; // use mandelFast()
+  double busySeconds;
 } WorkerArgs;
 
+// Tile orders of mandelbrotThreadDynamic.
+enum TileOrder { TILE_ORDER_ROW = 0, TILE_ORDER_MORTON, TILE_ORDER_HILBERT };
+
+typedef struct {
+  WorkerArgs base;
+  int tileSize;
+  const std::vector<int> *tiles; // tile indices in claiming order
+  std::atomic<int> *nextTile;
+} DynamicWorkerArgs;
+
 extern void mandelbrotSerial(float x0, float y0, float x1, float y1, int width,
                              int height, int startRow, int numRows,
                              int maxIterations, int output[]);
 
 extern void mandelbrotSerial2(float x0, float y0, float x1, float y1, int width,
                               int height, int startRow, int numThreads,
-                              int maxIterations, int output[]);
+                              int maxIterations, int output[], bool fast);
+
+extern void mandelbrotSerialTile(float x0, float y0, float x1, float y1,
+                                 int width, int height, int startCol,
+                                 int startRow, int tileWidth, int tileHeight,
+                                 int maxIterations, int output[], bool fast);
 
 //
 // workerThreadStart --
 //
 // Thread entrypoint.
 void workerThreadStart(WorkerArgs *const args) {
+  double startTime = CycleTimer::currentSeconds();
+
   // TODO FOR CS149 STUDENTS: Implement the body of the worker
   // thread here. Each thread should make a call to mandelbrotSerial()
   // to compute a part of the output image.  For example, in a
@@ -47,26 +69,30 @@ void workerThreadStart(WorkerArgs *const args) {
   ***/
   mandelbrotSerial2(args->x0, args->y0, args->x1, args->y1, args->width,
                     args->height, args->threadId, args->numThreads,
-                    args->maxIterations, args->output);
+                    args->maxIterations, args->output, args->fast);
+
+  args->busySeconds = CycleTimer::currentSeconds() - startTime;
 }
 
 //
 // MandelbrotThread --
 //
 // Multi-threaded implementation of mandelbrot set image generation.
-// Threads of execution are created by spawning std::threads.
+// Threads of execution are created by spawning std::threads. If
+// busySeconds is not NULL, busySeconds[i] receives the time thread i
+// spent computing. With fast set, pixels are computed with the interior
+// shortcuts of mandelFast(), which give the same output.
 void mandelbrotThread(int numThreads, float x0, float y0, float x1, float y1,
-                      int width, int height, int maxIterations, int output[]) {
-  static constexpr int MAX_THREADS = 32;
-
-  if (numThreads > MAX_THREADS) {
-    fprintf(stderr, "Error: Max allowed threads is %d\n", MAX_THREADS);
+                      int width, int height, int maxIterations, int output[],
+                      double busySeconds[], bool fast) {
+  if (numThreads < 1) {
+    fprintf(stderr, "Error: Need at least one thread\n");
     exit(1);
   }
 
   // Creates thread objects that do not yet represent a thread.
-  std::thread workers[MAX_THREADS];
-  WorkerArgs args[MAX_THREADS];
+  std::vector<std::thread> workers(numThreads);
+  std::vector<WorkerArgs> args(numThreads);
 
   for (int i = 0; i < numThreads; i++) {
 
@@ -84,6 +110,8 @@ void mandelbrotThread(int numThreads, float x0, float y0, float x1, float y1,
     args[i].output = output;
 
     args[i].threadId = i;
+    args[i].fast = fast;
+    args[i].busySeconds = 0;
   }
 
   // Spawn the worker threads.  Note that only numThreads-1 std::threads
@@ -99,4 +127,158 @@ void mandelbrotThread(int numThreads, float x0, float y0, float x1, float y1,
   for (int i = 1; i < numThreads; i++) {
     workers[i].join();
   }
+
+  if (busySeconds) {
+    for (int i = 0; i < numThreads; i++)
+      busySeconds[i] = args[i].busySeconds;
+  }
+}
+
+//
+// mortonIndex --
+//
+// Position of tile (x, y) on the Z-order curve: the bits of x and y
+// interleaved, x in the even bits.
+static unsigned int mortonIndex(unsigned int x, unsigned int y) {
+  unsigned int d = 0;
+  for (int b = 0; b < 16; b++) {
+    d |= ((x >> b) & 1u) << (2 * b);
+    d |= ((y >> b) & 1u) << (2 * b + 1);
+  }
+  return d;
+}
+
+//
+// hilbertIndex --
+//
+// Position of tile (x, y) on the Hilbert curve filling an n x n grid,
+// n a power of two.
+static unsigned int hilbertIndex(unsigned int n, unsigned int x,
+                                 unsigned int y) {
+  unsigned int d = 0;
+  for (unsigned int s = n / 2; s > 0; s /= 2) {
+    unsigned int rx = (x & s) > 0;
+    unsigned int ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant so the curve inside it starts at its origin.
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+//
+// tileOrder --
+//
+// Indices (row * tilesX + col) of a tilesX x tilesY grid of tiles, in
+// the order threads claim them.
+static std::vector<int> tileOrder(int tilesX, int tilesY, int order) {
+  std::vector<int> tiles(tilesX * tilesY);
+  for (int i = 0; i < tilesX * tilesY; i++)
+    tiles[i] = i;
+  if (order == TILE_ORDER_ROW)
+    return tiles;
+
+  unsigned int n = 1;
+  while (n < (unsigned int)std::max(tilesX, tilesY))
+    n *= 2;
+
+  std::vector<unsigned int> keys(tilesX * tilesY);
+  for (int i = 0; i < tilesX * tilesY; i++) {
+    unsigned int x = i % tilesX, y = i / tilesX;
+    keys[i] = order == TILE_ORDER_MORTON ? mortonIndex(x, y)
+                                         : hilbertIndex(n, x, y);
+  }
+  std::sort(tiles.begin(), tiles.end(),
+            [&keys](int a, int b) { return keys[a] < keys[b]; });
+  return tiles;
+}
+
+//
+// dynamicWorkerThreadStart --
+//
+// Thread entrypoint of mandelbrotThreadDynamic: claims tiles until
+// none are left.
+void dynamicWorkerThreadStart(DynamicWorkerArgs *const args) {
+  const WorkerArgs &a = args->base;
+  int tilesX = (a.width + args->tileSize - 1) / args->tileSize;
+  int numTiles = args->tiles->size();
+  double startTime = CycleTimer::currentSeconds();
+
+  int i;
+  while ((i = args->nextTile->fetch_add(1, std::memory_order_relaxed)) <
+         numTiles) {
+    int tile = (*args->tiles)[i];
+    mandelbrotSerialTile(a.x0, a.y0, a.x1, a.y1, a.width, a.height,
+                         (tile % tilesX) * args->tileSize,
+                         (tile / tilesX) * args->tileSize, args->tileSize,
+                         args->tileSize, a.maxIterations, a.output, a.fast);
+  }
+
+  args->base.busySeconds = CycleTimer::currentSeconds() - startTime;
+}
+
+//
+// MandelbrotThreadDynamic --
+//
+// Multi-threaded implementation that splits the image into
+// tileSize x tileSize tiles. Threads claim tiles one at a time from a
+// shared counter, in row-major, Morton or Hilbert order (a TileOrder),
+// so faster threads take on more of the work. busySeconds and fast are
+// as in mandelbrotThread.
+void mandelbrotThreadDynamic(int numThreads, int tileSize, int order, float x0,
+                             float y0, float x1, float y1, int width,
+                             int height, int maxIterations, int output[],
+                             double busySeconds[], bool fast) {
+  if (numThreads < 1 || tileSize < 1) {
+    fprintf(stderr, "Error: Need at least one thread and a tile size >= 1\n");
+    exit(1);
+  }
+
+  int tilesX = (width + tileSize - 1) / tileSize;
+  int tilesY = (height + tileSize - 1) / tileSize;
+  std::vector<int> tiles = tileOrder(tilesX, tilesY, order);
+  std::atomic<int> nextTile(0);
+
+  std::vector<std::thread> workers(numThreads);
+  std::vector<DynamicWorkerArgs> args(numThreads);
+
+  for (int i = 0; i < numThreads; i++) {
+    args[i].base.x0 = x0;
+    args[i].base.y0 = y0;
+    args[i].base.x1 = x1;
+    args[i].base.y1 = y1;
+    args[i].base.width = width;
+    args[i].base.height = height;
+    args[i].base.maxIterations = maxIterations;
+    args[i].base.numThreads = numThreads;
+    args[i].base.output = output;
+    args[i].base.threadId = i;
+    args[i].base.fast = fast;
+    args[i].base.busySeconds = 0;
+
+    args[i].tileSize = tileSize;
+    args[i].tiles = &tiles;
+    args[i].nextTile = &nextTile;
+  }
+
+  for (int i = 1; i < numThreads; i++) {
+    workers[i] = std::thread(dynamicWorkerThreadStart, &args[i]);
+  }
+
+  dynamicWorkerThreadStart(&args[0]);
+
+  for (int i = 1; i < numThreads; i++) {
+    workers[i].join();
+  }
+
+  if (busySeconds) {
+    for (int i = 0; i < numThreads; i++)
+      busySeconds[i] = args[i].base.busySeconds;
+  }
 }
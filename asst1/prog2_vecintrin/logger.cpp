@@ -1,39 +1,121 @@
 #include "logger.h"
 #include "CS149intrin.h"
 
-void Logger::addLog(const char * instruction, __cs149_mask mask, int N) {
+Logger::Logger()
+    : logLimit(-1), logNext(0), droppedLogs(0), stats(), numOpcodes(0),
+      width(VECTOR_WIDTH) {}
+
+// Keep only the last limit instructions for printLog(); 0 keeps none,
+// and a negative limit all of them. Call before running any kernel.
+void Logger::setLogLimit(long long limit) {
+  logLimit = limit;
+  reset();
+  if (logLimit > 0)
+    log.reserve(logLimit);
+}
+
+// Forget every instruction logged so far, keeping the log limit
+void Logger::reset() {
+  log.clear();
+  logNext = 0;
+  droppedLogs = 0;
+  stats = Statistics();
+  numOpcodes = 0;
+  width = VECTOR_WIDTH;
+}
+
+// Entry of the per-opcode table for instruction, or NULL once the table
+// is full. Intrinsics log with string literals, so comparing pointers
+// nearly always finds the entry without comparing strings.
+Statistics *Logger::opcodeStats(const char * instruction) {
+  for (int i=0; i<numOpcodes; i++) {
+    if (opcodes[i].instruction == instruction)
+      return &opcodes[i].stats;
+  }
+  for (int i=0; i<numOpcodes; i++) {
+    if (strcmp(opcodes[i].instruction, instruction) == 0)
+      return &opcodes[i].stats;
+  }
+  if (numOpcodes == MAX_OPCODES)
+    return NULL;
+  opcodes[numOpcodes].instruction = instruction;
+  opcodes[numOpcodes].stats = Statistics();
+  return &opcodes[numOpcodes++].stats;
+}
+
+void Logger::addLog(const char * instruction, const bool * mask, int N) {
   Log newLog;
-  strcpy(newLog.instruction, instruction);
   newLog.mask = 0;
+  unsigned long long utilized = 0;
   for (int i=0; i<N; i++) {
-    if (mask.value[i]) {
+    if (mask[i]) {
       newLog.mask |= (((unsigned long long)1)<<i);
-      stats.utilized_lane++;
+      utilized++;
     }
   }
+  stats.utilized_lane += utilized;
   stats.total_lane += N;
   stats.total_instructions += (N>0);
-  log.push_back(newLog);
+  if (N > 0)
+    width = N;
+
+  // user logs (N = 0) are not instructions
+  Statistics *opStats = N > 0 ? opcodeStats(instruction) : NULL;
+  if (opStats) {
+    opStats->utilized_lane += utilized;
+    opStats->total_lane += N;
+    opStats->total_instructions++;
+  }
+
+  if (logLimit == 0) {
+    droppedLogs++;
+    return;
+  }
+  newLog.width = width;
+  strncpy(newLog.instruction, instruction, MAX_INST_LEN - 1);
+  newLog.instruction[MAX_INST_LEN - 1] = '\0';
+  if (logLimit < 0 || (long long)log.size() < logLimit) {
+    log.push_back(newLog);
+  } else {
+    log[logNext] = newLog;
+    logNext = (logNext + 1) % logLimit;
+    droppedLogs++;
+  }
 }
 
 void Logger::printStats() {
   printf("****************** Printing Vector Unit Statistics *******************\n");
-  printf("Vector Width:              %d\n", VECTOR_WIDTH);
+  printf("Vector Width:              %d\n", width);
   printf("Total Vector Instructions: %lld\n", stats.total_instructions);
   printf("Vector Utilization:        %.1f%%\n", (double)stats.utilized_lane/stats.total_lane*100);
   printf("Utilized Vector Lanes:     %lld\n", stats.utilized_lane);
   printf("Total Vector Lanes:        %lld\n", stats.total_lane);
 }
 
-
+void Logger::printOpcodeStats() {
+  printf("******************* Printing Per-Opcode Statistics *******************\n");
+  printf(" Instruction | Instructions | Utilized Lanes |    Total Lanes | Utilization\n");
+  printf("------------- -------------- ---------------- ---------------- ------------\n");
+  for (int i=0; i<numOpcodes; i++) {
+    Statistics &s = opcodes[i].stats;
+    printf("%12s | %12llu | %14llu | %14llu | %10.1f%%\n",
+           opcodes[i].instruction, s.total_instructions, s.utilized_lane,
+           s.total_lane, (double)s.utilized_lane/s.total_lane*100);
+  }
+}
 
 void Logger::printLog() {
   printf("***************** Printing Vector Unit Execution Log *****************\n");
+  if (droppedLogs > 0)
+    printf("(%llu earlier entries not kept; showing the last %d)\n",
+           droppedLogs, (int)log.size());
   printf(" Instruction | Vector Lane Occupancy ('*' for active, '_' for inactive)\n");
   printf("------------- --------------------------------------------------------\n");
-  for (int i=0; i<log.size(); i++) {
+  // oldest first; once the ring buffer has wrapped that is at logNext
+  for (int k=0; k<log.size(); k++) {
+    int i = (logNext + k) % log.size();
     printf("%12s | ", log[i].instruction);
-    for (int j=0; j<VECTOR_WIDTH; j++) {
+    for (int j=0; j<log[i].width; j++) {
       if (log[i].mask & (((unsigned long long)1)<<j)) {
         printf("*");
       } else {
@@ -43,4 +125,3 @@ void Logger::printLog() {
     printf("\n");
   }
 }
-
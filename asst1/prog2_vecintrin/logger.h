@@ -7,12 +7,12 @@
 using namespace std;
 
 #define MAX_INST_LEN 32
-
-struct __cs149_mask;
+#define MAX_OPCODES 32
 
 struct Log {
   char instruction[MAX_INST_LEN];
   unsigned long long mask; // support vector width up to 64
+  int width;
 };
 
 struct Statistics {
@@ -21,14 +21,40 @@ struct Statistics {
   unsigned long long total_instructions;
 };
 
+// Totals of one opcode; instruction points to the name the intrinsic
+// logs with, which is a string literal
+struct OpcodeStatistics {
+  const char *instruction;
+  Statistics stats;
+};
+
+// By default every instruction is kept for printLog(), which takes
+// memory and time in proportion to the number of instructions run. With
+// setLogLimit(K), only the last K are kept, in a ring buffer, and with
+// K = 0 none are: the totals and the per-opcode table are kept in every
+// mode, so printStats() and printOpcodeStats() always cover the whole run.
 class Logger {
   private:
     vector<Log> log;
+    long long logLimit;     // < 0 for no limit
+    long long logNext;      // next slot of the ring buffer to overwrite
+    unsigned long long droppedLogs;
     Statistics stats;
+    OpcodeStatistics opcodes[MAX_OPCODES];
+    int numOpcodes;
+    int width;              // of the last instruction
+
+    Statistics *opcodeStats(const char * instruction);
 
   public:
-    void addLog(const char * instruction, __cs149_mask mask, int N = 0);
+    Logger();
+    void setLogLimit(long long limit);
+    void reset();
+    // mask holds the N lanes of the instruction
+    void addLog(const char * instruction, const bool * mask, int N = 0);
+    Statistics getStats() { return stats; }
     void printStats();
+    void printOpcodeStats();
     void printLog();
 };
 
@@ -12,28 +12,35 @@ Logger CS149Logger;
 
 void usage(const char *progname);
 void initValue(float *values, int *exponents, float *output, float *gold,
-               unsigned int N);
+               unsigned int N, unsigned int padding);
 void absSerial(float *values, float *output, int N);
 void absVector(float *values, float *output, int N);
 void clampedExpSerial(float *values, int *exponents, float *output, int N);
+template <int W = VECTOR_WIDTH>
 void clampedExpVector(float *values, int *exponents, float *output, int N);
 float arraySumSerial(float *values, int N);
-float arraySumVector(float *values, int N);
+template <int W = VECTOR_WIDTH> float arraySumVector(float *values, int N);
 bool verifyResult(float *values, int *exponents, float *output, float *gold,
                   int N);
+int sweepWidths(int N);
 
 int main(int argc, char *argv[]) {
   int N = 16;
   bool printLog = false;
+  long long logLimit = -1;
+  bool sweep = false;
 
   // parse commandline options ////////////////////////////////////////////
   int opt;
   static struct option long_options[] = {{"size", 1, 0, 's'},
                                          {"log", 0, 0, 'l'},
+                                         {"keep", 1, 0, 'k'},
+                                         {"sweep", 0, 0, 'w'},
                                          {"help", 0, 0, '?'},
                                          {0, 0, 0, 0}};
 
-  while ((opt = getopt_long(argc, argv, "s:l?", long_options, NULL)) != EOF) {
+  while ((opt = getopt_long(argc, argv, "s:lk:w?", long_options, NULL)) !=
+         EOF) {
 
     switch (opt) {
     case 's':
@@ -46,6 +53,16 @@ int main(int argc, char *argv[]) {
     case 'l':
       printLog = true;
       break;
+    case 'k':
+      logLimit = atoll(optarg);
+      if (logLimit < 0) {
+        printf("Error: Log limit is set to %lld (<0).\n", logLimit);
+        return -1;
+      }
+      break;
+    case 'w':
+      sweep = true;
+      break;
     case '?':
     default:
       usage(argv[0]);
@@ -53,11 +70,19 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (sweep)
+    return sweepWidths(N);
+
+  // with a limit the logger only keeps counters, and the last logLimit
+  // instructions, so large workloads can be profiled
+  if (logLimit >= 0)
+    CS149Logger.setLogLimit(logLimit);
+
   float *values = new float[N + VECTOR_WIDTH];
   int *exponents = new int[N + VECTOR_WIDTH];
   float *output = new float[N + VECTOR_WIDTH];
   float *gold = new float[N + VECTOR_WIDTH];
-  initValue(values, exponents, output, gold, N);
+  initValue(values, exponents, output, gold, N, VECTOR_WIDTH);
 
   clampedExpSerial(values, exponents, gold, N);
   clampedExpVector(values, exponents, output, N);
@@ -70,6 +95,8 @@ int main(int argc, char *argv[]) {
   if (printLog)
     CS149Logger.printLog();
   CS149Logger.printStats();
+  if (logLimit >= 0)
+    CS149Logger.printOpcodeStats();
 
   printf("************************ Result Verification "
          "*************************\n");
@@ -110,13 +137,19 @@ void usage(const char *progname) {
   printf("Program Options:\n");
   printf("  -s  --size <N>     Use workload size N (Default = 16)\n");
   printf("  -l  --log          Print vector unit execution log\n");
+  printf("  -k  --keep <K>     Keep only the last K instructions for the log "
+         "(0 keeps\n"
+         "                     none) and print per-opcode statistics\n");
+  printf("  -w  --sweep        Run the vector kernels at vector widths 2 to 32 "
+         "and\n"
+         "                     compare their lane utilization\n");
   printf("  -?  --help         This message\n");
 }
 
 void initValue(float *values, int *exponents, float *output, float *gold,
-               unsigned int N) {
+               unsigned int N, unsigned int padding) {
 
-  for (unsigned int i = 0; i < N + VECTOR_WIDTH; i++) {
+  for (unsigned int i = 0; i < N + padding; i++) {
     // random input values
     values[i] = -1.f + 4.f * static_cast<float>(rand()) / RAND_MAX;
     exponents[i] = rand() % EXP_MAX;
@@ -247,6 +280,7 @@ void clampedExpSerial(float *values, int *exponents, float *output, int N) {
   }
 }
 
+template <int W>
 void clampedExpVector(float *values, int *exponents, float *output, int N) {
   // CS149 STUDENTS TODO: Implement your vectorized version of
   // clampedExpSerial() here.
@@ -254,19 +288,22 @@ void clampedExpVector(float *values, int *exponents, float *output, int N) {
   // Your solution should work for any value of
   // N and VECTOR_WIDTH, not just when VECTOR_WIDTH divides N
   //
-  __cs149_vec_float xs;
-  __cs149_vec_int ys;
-  __cs149_vec_int ones = _cs149_vset_int(1);
-  __cs149_vec_int zeros = _cs149_vset_int(0);
-  __cs149_vec_float upperLims = _cs149_vset_float(9.999999f);
-  __cs149_mask notZeroMask;
-  __cs149_mask clampMask;
-  __cs149_mask allMask = _cs149_init_ones();
-  __cs149_vec_float results;
-
+  // (W is the vector width, VECTOR_WIDTH unless the caller gives another)
+  //
+  __cs149_vec_float_w<W> xs;
+  __cs149_vec_int_w<W> ys;
+  __cs149_vec_int_w<W> ones = _cs149_vset_int<W>(1);
+  __cs149_vec_int_w<W> zeros = _cs149_vset_int<W>(0);
+  __cs149_vec_float_w<W> upperLims = _cs149_vset_float<W>(9.999999f);
+  __cs149_mask_w<W> notZeroMask;
+  __cs149_mask_w<W> clampMask;
+  __cs149_mask_w<W> allMask = _cs149_init_ones<W>();
+  __cs149_vec_float_w<W> results;
+
+  // whole vectors only; the scalar loop below does the rest
   int i = 0;
-  for (; i < N; i += VECTOR_WIDTH) {
-    results = _cs149_vset_float(1.f);
+  for (; i + W <= N; i += W) {
+    results = _cs149_vset_float<W>(1.f);
     _cs149_vload_float(xs, values + i, allMask);
     _cs149_vload_int(ys, exponents + i, allMask);
     _cs149_vgt_int(notZeroMask, ys, zeros, allMask);
@@ -313,28 +350,28 @@ float arraySumSerial(float *values, int N) {
 // returns the sum of all elements in values
 // You can assume N is a multiple of VECTOR_WIDTH
 // You can assume VECTOR_WIDTH is a power of 2
-float arraySumVector(float *values, int N) {
+template <int W> float arraySumVector(float *values, int N) {
   // CS149 STUDENTS TODO: Implement your vectorized version of arraySumSerial
   // here
   //
-  __cs149_vec_float nums;
-  __cs149_vec_float results = _cs149_vset_float(0.f);
-  __cs149_mask allMask = _cs149_init_ones();
+  __cs149_vec_float_w<W> nums;
+  __cs149_vec_float_w<W> results = _cs149_vset_float<W>(0.f);
+  __cs149_mask_w<W> allMask = _cs149_init_ones<W>();
   float sum = 0.0;
 
   int i = 0;
-  for (; i < N; i += VECTOR_WIDTH) {
+  for (; i < N; i += W) {
     _cs149_vload_float(nums, values + i, allMask);
     _cs149_vadd_float(results, results, nums, allMask);
   }
 
-  int j = VECTOR_WIDTH;
+  int j = W;
   while ((j /= 2) > 0) {
     _cs149_hadd_float(results, results);
     _cs149_interleave_float(results, results);
   }
 
-  float output[VECTOR_WIDTH];
+  float output[W];
   _cs149_vstore_float(output, results, allMask);
   sum += output[0];
 
@@ -344,3 +381,108 @@ float arraySumVector(float *values, int N) {
 
   return sum;
 }
+
+// Vector widths the sweep runs at; buffers are padded for the widest
+static const int kSweepWidths[] = {2, 4, 8, 16, 32};
+static const int kNumSweepWidths = sizeof(kSweepWidths) / sizeof(int);
+static const int kMaxSweepWidth = 32;
+
+struct SweepResult {
+  bool clampedCorrect;
+  Statistics clampedStats;
+  bool sumRun; // arraySumVector needs N % W == 0
+  bool sumCorrect;
+  Statistics sumStats;
+};
+
+// Runs both vector kernels at width W, with fresh logger statistics
+// for each
+template <int W>
+SweepResult sweepWidth(float *values, int *exponents, float *output,
+                       float *gold, int N) {
+  SweepResult result;
+
+  for (int i = 0; i < N + kMaxSweepWidth; i++)
+    output[i] = 0.f;
+  CS149Logger.reset();
+  clampedExpVector<W>(values, exponents, output, N);
+  result.clampedStats = CS149Logger.getStats();
+  result.clampedCorrect = true;
+  for (int i = 0; i < N + kMaxSweepWidth; i++)
+    result.clampedCorrect &= abs(output[i] - gold[i]) <= 0.00001;
+
+  result.sumRun = N % W == 0;
+  result.sumCorrect = false;
+  result.sumStats = Statistics();
+  if (result.sumRun) {
+    CS149Logger.reset();
+    float sumOutput = arraySumVector<W>(values, N);
+    result.sumStats = CS149Logger.getStats();
+    result.sumCorrect = abs(arraySumSerial(values, N) - sumOutput) < 0.2;
+  }
+  return result;
+}
+
+static SweepResult sweepAtWidth(int width, float *values, int *exponents,
+                                float *output, float *gold, int N) {
+  switch (width) {
+  case 2:
+    return sweepWidth<2>(values, exponents, output, gold, N);
+  case 4:
+    return sweepWidth<4>(values, exponents, output, gold, N);
+  case 8:
+    return sweepWidth<8>(values, exponents, output, gold, N);
+  case 16:
+    return sweepWidth<16>(values, exponents, output, gold, N);
+  default:
+    return sweepWidth<32>(values, exponents, output, gold, N);
+  }
+}
+
+static void printSweepStats(const Statistics &stats, bool correct) {
+  printf(" %12llu %10.1f%% %-6s |", stats.total_instructions,
+         (double)stats.utilized_lane / stats.total_lane * 100,
+         correct ? "ok" : "FAILED");
+}
+
+// Runs clampedExpVector and arraySumVector on the same input at every
+// width in kSweepWidths, and tabulates instruction counts and vector
+// lane utilization. The logger only keeps counters meanwhile.
+int sweepWidths(int N) {
+  float *values = new float[N + kMaxSweepWidth];
+  int *exponents = new int[N + kMaxSweepWidth];
+  float *output = new float[N + kMaxSweepWidth];
+  float *gold = new float[N + kMaxSweepWidth];
+  initValue(values, exponents, output, gold, N, kMaxSweepWidth);
+  clampedExpSerial(values, exponents, gold, N);
+
+  CS149Logger.setLogLimit(0);
+
+  printf("\e[1;31mVECTOR WIDTH SWEEP\e[0m (N = %d)\n", N);
+  printf("       |        CLAMPED EXPONENT         |            ARRAY SUM\n");
+  printf(" Width | Instructions Utilization Result | Instructions Utilization "
+         "Result\n");
+  printf("------- --------------------------------- "
+         "---------------------------------\n");
+  bool allCorrect = true;
+  for (int w = 0; w < kNumSweepWidths; w++) {
+    int width = kSweepWidths[w];
+    SweepResult r = sweepAtWidth(width, values, exponents, output, gold, N);
+
+    printf(" %5d |", width);
+    printSweepStats(r.clampedStats, r.clampedCorrect);
+    if (r.sumRun)
+      printSweepStats(r.sumStats, r.sumCorrect);
+    else
+      printf(" (needs N %% %d == 0)", width);
+    printf("\n");
+    allCorrect &= r.clampedCorrect && (!r.sumRun || r.sumCorrect);
+  }
+
+  delete[] values;
+  delete[] exponents;
+  delete[] output;
+  delete[] gold;
+
+  return allCorrect ? 0 : 1;
+}
@@ -1,21 +1,43 @@
 #include <algorithm>
 #include <getopt.h>
 #include <stdio.h>
+#include <vector>
 
 #include "../common/CycleTimer.h"
+#include "../common/mandelPerturb.h"
+#include "../common/tasksys.h"
 #include "mandelbrot_ispc.h"
+#ifdef ISPC_USE_ITASKSYS
+#include "../../asst2/part_b/tasksys.h"
+#endif
 
 extern void mandelbrotSerial(float x0, float y0, float x1, float y1, int width,
                              int height, int startRow, int numRows,
                              int maxIterations, int output[]);
 
-extern void mandelbrotThread(int numThreads, float x0, float y0, float x1,
-                             float y1, int width, int height, int maxIterations,
-                             int output[]);
+extern void mandelbrotAVX2(float x0, float y0, float x1, float y1, int width,
+                           int height, int startRow, int numRows,
+                           int maxIterations, int output[]);
+
+extern void mandelbrotAVX512(float x0, float y0, float x1, float y1, int width,
+                             int height, int startRow, int numRows,
+                             int maxIterations, int output[]);
+
+extern bool mandelbrotAVX2Supported();
+extern bool mandelbrotAVX512Supported();
 
 extern void writePPMImage(int *data, int width, int height,
                           const char *filename, int maxIterations);
 
+typedef void (*RenderBandFunc)(void *context, int startRow, int numRows,
+                               int band[]);
+
+extern long long writePPMImageStreaming(const char *filename, int width,
+                                        int height, int maxIterations,
+                                        int numThreads, int bandRows,
+                                        RenderBandFunc renderBand,
+                                        void *context);
+
 bool verifyResult(int *gold, int *result, int width, int height) {
   int i, j;
 
@@ -51,10 +73,191 @@ void usage(const char *progname) {
   printf("Usage: %s [options]\n", progname);
   printf("Program Options:\n");
   printf("  -t  --tasks        Run ISPC code implementation with tasks\n");
-  printf("  -v  --view <INT>   Use specified view settings\n");
+  printf("  -v  --view <INT>   Use specified view settings (3: deep zoom with\n");
+  printf("                     perturbation theory, %d iterations)\n",
+         kDeepMaxIterations);
+  printf("  -n  --threads <N>  Run ISPC tasks on N threads (default: all CPUs)\n");
+  printf("  -p  --pin          Pin ISPC task threads to CPUs\n");
+  printf("  -f  --fast         Also run the ISPC code with interior shortcuts\n");
+  printf("  -s  --sweep        Only time the ISPC tasks code for a range of\n");
+  printf("                     task counts, to tune it for this machine\n");
+  printf("  -w  --stream <W>x<H> Only render a WxH image in bands straight to\n");
+  printf("                     mandelbrot-stream.ppm, with bounded memory\n");
   printf("  -?  --help         This message\n");
 }
 
+typedef struct {
+  float x0, y0, x1, y1;
+  int width, height;
+  int maxIterations;
+  bool fast;
+} StreamArgs;
+
+void renderStreamBand(void *context, int startRow, int numRows, int band[]) {
+  StreamArgs *a = (StreamArgs *)context;
+  mandelbrot_ispc_band(a->x0, a->y0, a->x1, a->y1, a->width, a->height,
+                       startRow, numRows, a->maxIterations, a->fast, band);
+}
+
+//
+// renderStreaming --
+//
+// Renders a streamWidth x streamHeight image of the view in bands of
+// about 1M pixels, each band running the ISPC code on one of numThreads
+// threads, without ever holding the whole image in memory.
+int renderStreaming(int numThreads, int streamWidth, int streamHeight,
+                    float x0, float y0, float x1, float y1, int maxIterations,
+                    bool fast) {
+  StreamArgs args = {x0,          y0,           x1,            y1,
+                     streamWidth, streamHeight, maxIterations, fast};
+  int bandRows = std::max(1, (1 << 20) / streamWidth);
+
+  double startTime = CycleTimer::currentSeconds();
+  long long bufferBytes = writePPMImageStreaming(
+      "mandelbrot-stream.ppm", streamWidth, streamHeight, maxIterations,
+      numThreads, bandRows, renderStreamBand, &args);
+  double endTime = CycleTimer::currentSeconds();
+  if (bufferBytes < 0)
+    return 1;
+
+  double pixels = (double)streamWidth * streamHeight;
+  printf("[mandelbrot stream %dx%d]:\t[%.3f] ms (%.1f Mpixels/s, %.1f MB of "
+         "band buffers for a %.1f MB image)\n",
+         streamWidth, streamHeight, (endTime - startTime) * 1000,
+         pixels / (endTime - startTime) / 1e6, bufferBytes / 1e6,
+         pixels * 3 / 1e6);
+  return 0;
+}
+
+//
+// sweepTaskCounts --
+//
+// Times mandelbrot_ispc_withtasks with the automatic task count and with
+// 1, 2, 4, ... tasks up to one per row, checking each against gold, and
+// reports the fastest count.
+int sweepTaskCounts(float x0, float y0, float x1, float y1, int width,
+                    int height, int maxIterations, int *gold, int *output) {
+  printf("[ispc task system]:\t\t[%d] threads\n", ISPCTaskSystemThreads());
+
+  int bestTasks = 0;
+  double bestTime = 1e30, autoTime = 0;
+  for (int numTasks = 0; numTasks <= height;) {
+    double minTime = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      ispc::mandelbrot_ispc_withtasks(x0, y0, x1, y1, width, height,
+                                      maxIterations, output, numTasks);
+      double endTime = CycleTimer::currentSeconds();
+      minTime = std::min(minTime, endTime - startTime);
+    }
+    if (!verifyResult(gold, output, width, height)) {
+      printf("Error : ISPC output with %d tasks differs from sequential "
+             "output\n",
+             numTasks);
+      return 1;
+    }
+
+    if (numTasks == 0) {
+      printf("[tasks auto]:\t\t\t[%.3f] ms\n", minTime * 1000);
+      autoTime = minTime;
+    } else {
+      printf("[tasks %d]:\t\t\t[%.3f] ms\n", numTasks, minTime * 1000);
+      if (minTime < bestTime) {
+        bestTime = minTime;
+        bestTasks = numTasks;
+      }
+    }
+
+    // powers of two, then one task per row
+    if (numTasks == height)
+      break;
+    numTasks = std::min(numTasks > 0 ? 2 * numTasks : 1, height);
+  }
+
+  printf("[best]:\t\t\t\t%d tasks, [%.3f] ms (%.2fx of auto)\n", bestTasks,
+         bestTime * 1000, autoTime / bestTime);
+  return 0;
+}
+
+//
+// renderDeep --
+//
+// Renders the deep zoom of view 3 with perturbation theory, with the
+// ISPC code and (with useTasks) ISPC tasks. Float and double cannot
+// resolve its pixels, so the result is checked against brute-force
+// __float128 iteration on a sample of pixels.
+int renderDeep(bool useTasks, int width, int height, int maxIterations) {
+  std::vector<double> orbitRe, orbitIm;
+  double startTime = CycleTimer::currentSeconds();
+  mandelReferenceOrbit(kDeepCenterRe, kDeepCenterIm, maxIterations, orbitRe,
+                       orbitIm);
+  double orbitTime = CycleTimer::currentSeconds() - startTime;
+  printf("[reference orbit]:\t\t[%.3f] ms (%d elements)\n", orbitTime * 1000,
+         (int)orbitRe.size());
+
+  double pixelSize = kDeepWidth / width;
+  double dx0 = -pixelSize * (width / 2), dy0 = -pixelSize * (height / 2);
+  std::vector<int> output((size_t)width * height);
+  std::vector<int> output_tasks((size_t)width * height);
+
+  // Deep zooms take long enough to time a single run
+  startTime = CycleTimer::currentSeconds();
+  ispc::mandelbrot_ispc_perturb(dx0, dy0, pixelSize, width, height,
+                                orbitRe.data(), orbitIm.data(), orbitRe.size(),
+                                maxIterations, output.data());
+  double minISPC = CycleTimer::currentSeconds() - startTime;
+  printf("[mandelbrot perturb ispc]:\t[%.3f] ms\n", minISPC * 1000);
+  writePPMImage(output.data(), width, height, "mandelbrot-deep.ppm",
+                maxIterations);
+
+  if (useTasks) {
+    startTime = CycleTimer::currentSeconds();
+    ispc::mandelbrot_ispc_perturb_withtasks(
+        dx0, dy0, pixelSize, width, height, orbitRe.data(), orbitIm.data(),
+        orbitRe.size(), maxIterations, output_tasks.data());
+    double minTaskISPC = CycleTimer::currentSeconds() - startTime;
+    printf("[mandelbrot perturb tasks]:\t[%.3f] ms\n", minTaskISPC * 1000);
+    printf("\t\t\t\t(%.2fx speedup from task parallelism)\n",
+           minISPC / minTaskISPC);
+
+    if (!verifyResult(output.data(), output_tasks.data(), width, height)) {
+      printf("Error : ISPC output differs from ISPC tasks output\n");
+      return 1;
+    }
+  }
+
+  // Check about 1000 pixels spread over the image
+  const int numSamples = 1000;
+  size_t numPixels = (size_t)width * height;
+  int agree = 0;
+  double quadTime = 0;
+  for (int s = 0; s < numSamples; s++) {
+    size_t p = s * (numPixels / numSamples) + s % width;
+    if (p >= numPixels)
+      p = numPixels - 1;
+    int i = p % width, j = p / width;
+    double startTime = CycleTimer::currentSeconds();
+    int count = mandelQuad(kDeepCenterRe, kDeepCenterIm, dx0 + i * pixelSize,
+                           dy0 + j * pixelSize, maxIterations);
+    quadTime += CycleTimer::currentSeconds() - startTime;
+    agree += count == output[p];
+  }
+
+  printf("[__float128 check]:\t\t%d of %d sampled pixels agree\n", agree,
+         numSamples);
+  printf("\t\t\t\t(%.2fx speedup of ISPC over serial __float128, "
+         "estimated)\n",
+         quadTime * numPixels / numSamples / minISPC);
+
+  // Perturbation in double can flip the count of the odd pixel whose
+  // orbit comes within rounding of escaping
+  if (agree < numSamples * 99 / 100) {
+    printf("Error : Perturbation output differs from __float128 output\n");
+    return 1;
+  }
+  return 0;
+}
+
 int main(int argc, char **argv) {
 
   const unsigned int width = 1200;
@@ -67,15 +270,26 @@ int main(int argc, char **argv) {
   float y1 = 1;
 
   bool useTasks = false;
+  int numThreads = 0;
+  bool pinThreads = false;
+  bool fast = false;
+  bool deepView = false;
+  bool sweep = false;
+  int streamWidth = 0, streamHeight = 0; // 0 for the usual runs
 
   // parse commandline options ////////////////////////////////////////////
   int opt;
   static struct option long_options[] = {{"tasks", 0, 0, 't'},
                                          {"view", 1, 0, 'v'},
+                                         {"threads", 1, 0, 'n'},
+                                         {"pin", 0, 0, 'p'},
+                                         {"fast", 0, 0, 'f'},
+                                         {"sweep", 0, 0, 's'},
+                                         {"stream", 1, 0, 'w'},
                                          {"help", 0, 0, '?'},
                                          {0, 0, 0, 0}};
 
-  while ((opt = getopt_long(argc, argv, "tv:?", long_options, NULL)) != EOF) {
+  while ((opt = getopt_long(argc, argv, "tv:n:psfw:?", long_options, NULL)) != EOF) {
 
     switch (opt) {
     case 't':
@@ -89,12 +303,34 @@ int main(int argc, char **argv) {
         float shiftX = -.986f;
         float shiftY = .30f;
         scaleAndShift(x0, x1, y0, y1, scaleValue, shiftX, shiftY);
+      } else if (viewIndex == 3) {
+        deepView = true;
       } else if (viewIndex > 1) {
         fprintf(stderr, "Invalid view index\n");
         return 1;
       }
       break;
     }
+    case 'n':
+      numThreads = atoi(optarg);
+      break;
+    case 'p':
+      pinThreads = true;
+      break;
+    case 's':
+      sweep = true;
+      break;
+    case 'f':
+      fast = true;
+      break;
+    case 'w': {
+      if (sscanf(optarg, "%dx%d", &streamWidth, &streamHeight) != 2 ||
+          streamWidth < 1 || streamHeight < 1) {
+        fprintf(stderr, "Invalid image size %s\n", optarg);
+        return 1;
+      }
+      break;
+    }
     case '?':
     default:
       usage(argv[0]);
@@ -103,6 +339,20 @@ int main(int argc, char **argv) {
   }
   // end parsing of commandline options
 
+  if (numThreads > 0 || pinThreads) {
+    ISPCInitTaskSystem(numThreads, pinThreads);
+    printf("[ispc task system]:\t\t[%d] threads%s\n", ISPCTaskSystemThreads(),
+           pinThreads ? ", pinned" : "");
+  }
+
+  if (deepView)
+    return renderDeep(useTasks, width, height, kDeepMaxIterations);
+  if (streamWidth > 0)
+    return renderStreaming(numThreads > 0 ? numThreads
+                                          : ISPCTaskSystemThreads(),
+                           streamWidth, streamHeight, x0, y0, x1, y1,
+                           maxIterations, fast);
+
   int *output_serial = new int[width * height];
   int *output_ispc = new int[width * height];
   int *output_ispc_tasks = new int[width * height];
@@ -127,6 +377,10 @@ int main(int argc, char **argv) {
   writePPMImage(output_serial, width, height, "mandelbrot-serial.ppm",
                 maxIterations);
 
+  if (sweep)
+    return sweepTaskCounts(x0, y0, x1, y1, width, height, maxIterations,
+                           output_serial, output_ispc_tasks);
+
   // Clear out the buffer
   for (unsigned int i = 0; i < width * height; ++i)
     output_ispc[i] = 0;
@@ -156,6 +410,52 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  //
+  // Compare against the hand-vectorized intrinsics kernels the CPU
+  // supports
+  //
+  struct {
+    const char *name;
+    bool supported;
+    void (*kernel)(float, float, float, float, int, int, int, int, int, int *);
+  } simdKernels[] = {
+      {"avx2", mandelbrotAVX2Supported(), mandelbrotAVX2},
+      {"avx512", mandelbrotAVX512Supported(), mandelbrotAVX512},
+  };
+
+  for (auto &k : simdKernels) {
+    if (!k.supported) {
+      printf("[mandelbrot %s]:\t\t(not supported by this CPU)\n", k.name);
+      continue;
+    }
+
+    for (unsigned int i = 0; i < width * height; ++i)
+      output_ispc_tasks[i] = 0;
+
+    double minSIMD = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      k.kernel(x0, y0, x1, y1, width, height, 0, height, maxIterations,
+               output_ispc_tasks);
+      double endTime = CycleTimer::currentSeconds();
+      minSIMD = std::min(minSIMD, endTime - startTime);
+    }
+
+    printf("[mandelbrot %s]:\t\t[%.3f] ms\n", k.name, minSIMD * 1000);
+
+    if (!verifyResult(output_serial, output_ispc_tasks, width, height)) {
+      printf("Error : %s output differs from sequential output\n", k.name);
+
+      delete[] output_serial;
+      delete[] output_ispc;
+      delete[] output_ispc_tasks;
+
+      return 1;
+    }
+    printf("\t\t\t\t(%.2fx speedup from %s, %.2fx of ISPC)\n",
+           minSerial / minSIMD, k.name, minISPC / minSIMD);
+  }
+
   // Clear out the buffer
   for (unsigned int i = 0; i < width * height; ++i) {
     output_ispc_tasks[i] = 0;
@@ -169,7 +469,7 @@ int main(int argc, char **argv) {
     for (int i = 0; i < 3; ++i) {
       double startTime = CycleTimer::currentSeconds();
       mandelbrot_ispc_withtasks(x0, y0, x1, y1, width, height, maxIterations,
-                                output_ispc_tasks);
+                                output_ispc_tasks, 0);
       double endTime = CycleTimer::currentSeconds();
       minTaskISPC = std::min(minTaskISPC, endTime - startTime);
     }
@@ -182,12 +482,95 @@ int main(int argc, char **argv) {
       printf("Error : ISPC output differs from sequential output\n");
       return 1;
     }
+
+#ifdef ISPC_USE_ITASKSYS
+    //
+    // Same tasks, run as bulk launches on the asst2 thread pool
+    //
+    TaskSystemParallelThreadPoolSleeping taskSystem(
+        numThreads > 0 ? numThreads : ISPCTaskSystemThreads());
+    ISPCSetTaskSystem(&taskSystem);
+
+    for (unsigned int i = 0; i < width * height; ++i)
+      output_ispc_tasks[i] = 0;
+
+    double minTaskSys = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      mandelbrot_ispc_withtasks(x0, y0, x1, y1, width, height, maxIterations,
+                                output_ispc_tasks, 0);
+      double endTime = CycleTimer::currentSeconds();
+      minTaskSys = std::min(minTaskSys, endTime - startTime);
+    }
+    ISPCSetTaskSystem(NULL);
+
+    printf("[mandelbrot ispc on %s]:\t[%.3f] ms\n", taskSystem.name(),
+           minTaskSys * 1000);
+
+    if (!verifyResult(output_serial, output_ispc_tasks, width, height)) {
+      printf("Error : ISPC output differs from sequential output\n");
+      return 1;
+    }
+    printf("\t\t\t\t(%.2fx speedup over the built-in ISPC task system)\n",
+           minTaskISPC / minTaskSys);
+#endif
+  }
+
+  double minFastISPC = 1e30, minFastTaskISPC = 1e30;
+  if (fast) {
+    //
+    // ISPC code with the cardioid/bulb tests and periodicity checks
+    //
+    for (unsigned int i = 0; i < width * height; ++i)
+      output_ispc[i] = 0;
+
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      mandelbrot_ispc_fast(x0, y0, x1, y1, width, height, maxIterations,
+                           output_ispc);
+      double endTime = CycleTimer::currentSeconds();
+      minFastISPC = std::min(minFastISPC, endTime - startTime);
+    }
+
+    printf("[mandelbrot fast ispc]:\t\t[%.3f] ms\n", minFastISPC * 1000);
+
+    if (!verifyResult(output_serial, output_ispc, width, height)) {
+      printf("Error : Fast ISPC output differs from sequential output\n");
+      return 1;
+    }
+
+    if (useTasks) {
+      for (unsigned int i = 0; i < width * height; ++i)
+        output_ispc_tasks[i] = 0;
+
+      for (int i = 0; i < 3; ++i) {
+        double startTime = CycleTimer::currentSeconds();
+        mandelbrot_ispc_fast_withtasks(x0, y0, x1, y1, width, height,
+                                       maxIterations, output_ispc_tasks, 0);
+        double endTime = CycleTimer::currentSeconds();
+        minFastTaskISPC = std::min(minFastTaskISPC, endTime - startTime);
+      }
+
+      printf("[mandelbrot fast multicore ispc]:\t[%.3f] ms\n",
+             minFastTaskISPC * 1000);
+
+      if (!verifyResult(output_serial, output_ispc_tasks, width, height)) {
+        printf("Error : Fast ISPC output differs from sequential output\n");
+        return 1;
+      }
+    }
   }
 
   printf("\t\t\t\t(%.2fx speedup from ISPC)\n", minSerial / minISPC);
   if (useTasks) {
     printf("\t\t\t\t(%.2fx speedup from task ISPC)\n", minSerial / minTaskISPC);
   }
+  if (fast) {
+    printf("\t\t\t\t(%.2fx speedup from fast ISPC)\n", minSerial / minFastISPC);
+    if (useTasks)
+      printf("\t\t\t\t(%.2fx speedup from fast task ISPC)\n",
+             minSerial / minFastTaskISPC);
+  }
 
   delete[] output_serial;
   delete[] output_ispc;
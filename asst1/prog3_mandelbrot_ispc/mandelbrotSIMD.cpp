@@ -0,0 +1,181 @@
+#include <immintrin.h>
+
+//
+// Hand-vectorized versions of mandelbrotSerial for AVX2 (8 lanes) and
+// AVX-512 (16 lanes).
+//
+// Every lane iterates its own pixel. As soon as a lane's pixel escapes
+// or reaches maxIterations, its count is stored and the lane is refilled
+// with the next pixel of the rows, so lanes never idle while their
+// neighbors finish long orbits. The kernel returns when no pixels are
+// left and all lanes are done.
+//
+// The arithmetic is the same sequence of float operations as mandel()
+// in mandelbrotSerial.cpp, so the output is bit-identical as long as the
+// compiler does not fuse multiplies and adds (see the Makefile).
+//
+
+//
+// PixelStream --
+//
+// Hands out the pixels of the rows in order and refills finished lanes.
+template <int N> struct PixelStream {
+  float x0, y0, dx, dy;
+  int width;
+  int col, row, endRow; // next pixel
+  int *output;
+  int pixel[N];         // pixel of each lane, -1 once none are left
+  alignas(64) int iter[N];
+  alignas(64) float newRe[N];
+  alignas(64) float newIm[N];
+  int active;           // lanes with a pixel
+
+  //
+  // refill --
+  //
+  // Stores the counts (in iter) of the lanes set in doneMask and puts
+  // the c of their next pixels in newRe and newIm. Lanes without a
+  // pixel left are parked on c = 0, which never escapes.
+  void refill(unsigned int doneMask) {
+    while (doneMask) {
+      int l = __builtin_ctz(doneMask);
+      doneMask &= doneMask - 1;
+
+      if (pixel[l] >= 0) {
+        output[pixel[l]] = iter[l];
+        active--;
+      }
+      if (row < endRow) {
+        newRe[l] = x0 + col * dx;
+        newIm[l] = y0 + row * dy;
+        pixel[l] = row * width + col;
+        active++;
+        if (++col == width) {
+          col = 0;
+          row++;
+        }
+      } else {
+        newRe[l] = newIm[l] = 0.f;
+        pixel[l] = -1;
+      }
+    }
+  }
+
+  PixelStream(float x0, float y0, float x1, float y1, int width, int height,
+              int startRow, int numRows, int output[])
+      : x0(x0), y0(y0), dx((x1 - x0) / width), dy((y1 - y0) / height),
+        width(width), col(0), row(startRow), endRow(startRow + numRows),
+        output(output), active(0) {
+    for (int l = 0; l < N; l++) {
+      pixel[l] = -1;
+      iter[l] = 0;
+    }
+    refill((1u << N) - 1);
+  }
+};
+
+__attribute__((target("avx2"))) void
+mandelbrotAVX2(float x0, float y0, float x1, float y1, int width, int height,
+               int startRow, int numRows, int maxIterations, int output[]) {
+  PixelStream<8> s(x0, y0, x1, y1, width, height, startRow, numRows, output);
+  if (s.active == 0)
+    return;
+
+  __m256 cRe = _mm256_load_ps(s.newRe), cIm = _mm256_load_ps(s.newIm);
+  __m256 zRe = cRe, zIm = cIm;
+  __m256i iter = _mm256_setzero_si256();
+
+  const __m256 four = _mm256_set1_ps(4.f);
+  const __m256 two = _mm256_set1_ps(2.f);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i count = _mm256_set1_epi32(maxIterations);
+
+  while (true) {
+    __m256 zRe2 = _mm256_mul_ps(zRe, zRe);
+    __m256 zIm2 = _mm256_mul_ps(zIm, zIm);
+    __m256 escaped =
+        _mm256_cmp_ps(_mm256_add_ps(zRe2, zIm2), four, _CMP_GT_OQ);
+    __m256 finished = _mm256_castsi256_ps(_mm256_cmpeq_epi32(iter, count));
+    __m256 done = _mm256_or_ps(escaped, finished);
+    unsigned int doneMask = _mm256_movemask_ps(done);
+
+    if (doneMask) {
+      _mm256_store_si256((__m256i *)s.iter, iter);
+      s.refill(doneMask);
+      if (s.active == 0)
+        return;
+      cRe = _mm256_blendv_ps(cRe, _mm256_load_ps(s.newRe), done);
+      cIm = _mm256_blendv_ps(cIm, _mm256_load_ps(s.newIm), done);
+      zRe = _mm256_blendv_ps(zRe, cRe, done);
+      zIm = _mm256_blendv_ps(zIm, cIm, done);
+      iter = _mm256_andnot_si256(_mm256_castps_si256(done), iter);
+      // The refilled lanes may escape right away, so check again.
+      continue;
+    }
+
+    __m256 newRe = _mm256_sub_ps(zRe2, zIm2);
+    __m256 newIm = _mm256_mul_ps(_mm256_mul_ps(two, zRe), zIm);
+    zRe = _mm256_add_ps(cRe, newRe);
+    zIm = _mm256_add_ps(cIm, newIm);
+    iter = _mm256_add_epi32(iter, one);
+  }
+}
+
+__attribute__((target("avx512f"))) void
+mandelbrotAVX512(float x0, float y0, float x1, float y1, int width, int height,
+                 int startRow, int numRows, int maxIterations, int output[]) {
+  PixelStream<16> s(x0, y0, x1, y1, width, height, startRow, numRows, output);
+  if (s.active == 0)
+    return;
+
+  __m512 cRe = _mm512_load_ps(s.newRe), cIm = _mm512_load_ps(s.newIm);
+  __m512 zRe = cRe, zIm = cIm;
+  __m512i iter = _mm512_setzero_si512();
+
+  const __m512 four = _mm512_set1_ps(4.f);
+  const __m512 two = _mm512_set1_ps(2.f);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i count = _mm512_set1_epi32(maxIterations);
+
+  while (true) {
+    __m512 zRe2 = _mm512_mul_ps(zRe, zRe);
+    __m512 zIm2 = _mm512_mul_ps(zIm, zIm);
+    __mmask16 escaped =
+        _mm512_cmp_ps_mask(_mm512_add_ps(zRe2, zIm2), four, _CMP_GT_OQ);
+    __mmask16 done = escaped | _mm512_cmpeq_epi32_mask(iter, count);
+
+    if (done) {
+      _mm512_store_si512(s.iter, iter);
+      s.refill(done);
+      if (s.active == 0)
+        return;
+      cRe = _mm512_mask_load_ps(cRe, done, s.newRe);
+      cIm = _mm512_mask_load_ps(cIm, done, s.newIm);
+      zRe = _mm512_mask_mov_ps(zRe, done, cRe);
+      zIm = _mm512_mask_mov_ps(zIm, done, cIm);
+      iter = _mm512_maskz_mov_epi32(~done, iter);
+      // The refilled lanes may escape right away, so check again.
+      continue;
+    }
+
+    __m512 newRe = _mm512_sub_ps(zRe2, zIm2);
+    __m512 newIm = _mm512_mul_ps(_mm512_mul_ps(two, zRe), zIm);
+    zRe = _mm512_add_ps(cRe, newRe);
+    zIm = _mm512_add_ps(cIm, newIm);
+    iter = _mm512_add_epi32(iter, one);
+  }
+}
+
+//
+// Kernel selection: whether the CPU supports the instructions of each
+// kernel, checked through CPUID.
+//
+bool mandelbrotAVX2Supported() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+bool mandelbrotAVX512Supported() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f");
+}
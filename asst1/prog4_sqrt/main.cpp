@@ -1,15 +1,56 @@
 #include <algorithm>
+#include <getopt.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "CycleTimer.h"
+#include "tasksys.h"
 #include "sqrt_ispc.h"
 
 using namespace ispc;
 
+static void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("Program Options:\n");
+  printf("  -n  --threads <N>  Run ISPC tasks on N threads (default: all CPUs)\n");
+  printf("  -p  --pin          Pin ISPC task threads to CPUs\n");
+  printf("  -d  --dist <D>     Input values: random (default), best, worst,\n");
+  printf("                     or all three in turn\n");
+  printf("  -s  --sweep        Only time the ISPC tasks code for a range of\n");
+  printf("                     task counts, to tune it for this machine\n");
+  printf("  -?  --help         This message\n");
+}
+
 extern void sqrtSerial(int N, float startGuess, float *values, float *output);
 
+extern void sqrtBinned(int N, float initialGuess, float *values,
+                       float *output);
+
+// Input distributions, by the speedup sqrt_ispc gets over sqrtSerial
+static const char *distNames[] = {"random", "best", "worst"};
+static const int numDists = 3;
+
+//
+// fillValues --
+//
+// Fills values with distribution dist: random values in (0, 3); the
+// best case for ISPC, where every element takes the same, large number
+// of iterations; or the worst case, where one lane of each 8-wide gang
+// takes that many iterations and the other seven none.
+static void fillValues(int dist, int N, float *values) {
+  for (int i = 0; i < N; i++) {
+    if (dist == 0)
+      values[i] = .001f + 2.998f * static_cast<float>(rand()) / RAND_MAX;
+    else if (dist == 1)
+      values[i] = 2.999f;
+    else
+      values[i] = i % 8 == 0 ? 2.999f : 1.f;
+  }
+}
+
 static void verifyResult(int N, float *result, float *gold) {
   for (int i = 0; i < N; i++) {
     if (fabs(result[i] - gold[i]) > 1e-4) {
@@ -18,7 +59,114 @@ static void verifyResult(int N, float *result, float *gold) {
   }
 }
 
-int main() {
+// Checks result against the output of sqrtSerial. Both stop at a
+// residual |guess^2 x - 1| of at most 1e-5, so they are each within
+// 5e-6 of the true square root, relative to it.
+static void verifyRelative(int N, float *result, float *serial) {
+  for (int i = 0; i < N; i++) {
+    if (fabs(result[i] - serial[i]) > 1e-5 * fabs(serial[i])) {
+      printf("Error: [%d] Got %f expected %f (sqrtSerial)\n", i, result[i],
+             serial[i]);
+    }
+  }
+}
+
+//
+// sweepTaskCounts --
+//
+// Times sqrt_ispc_withtasks with the automatic task count and with 1, 2,
+// 4, ... tasks up to 16 per thread (and at least 64), and reports the
+// fastest count.
+static void sweepTaskCounts(int N, float initialGuess, float *values,
+                            float *output, float *gold) {
+  int threads = ISPCTaskSystemThreads();
+  printf("[ispc task system]:\t\t[%d] threads\n", threads);
+
+  int maxTasks = std::min(N, std::max(64, 16 * threads));
+  int bestTasks = 0;
+  double bestTime = 1e30, autoTime = 0;
+  for (int numTasks = 0; numTasks <= maxTasks;
+       numTasks = numTasks > 0 ? 2 * numTasks : 1) {
+    double minTime = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      sqrt_ispc_withtasks(N, initialGuess, values, output, numTasks);
+      double endTime = CycleTimer::currentSeconds();
+      minTime = std::min(minTime, endTime - startTime);
+    }
+    verifyResult(N, output, gold);
+
+    if (numTasks == 0) {
+      printf("[tasks auto]:\t\t[%.3f] ms\n", minTime * 1000);
+      autoTime = minTime;
+    } else {
+      printf("[tasks %d]:\t\t[%.3f] ms\n", numTasks, minTime * 1000);
+      if (minTime < bestTime) {
+        bestTime = minTime;
+        bestTasks = numTasks;
+      }
+    }
+  }
+
+  printf("[best]:\t\t\t%d tasks, [%.3f] ms (%.2fx of auto)\n", bestTasks,
+         bestTime * 1000, autoTime / bestTime);
+}
+
+int main(int argc, char **argv) {
+
+  int numThreads = 0;
+  bool pinThreads = false;
+  bool sweep = false;
+  int firstDist = 0, lastDist = 0;
+
+  // parse commandline options ////////////////////////////////////////////
+  int opt;
+  static struct option long_options[] = {{"threads", 1, 0, 'n'},
+                                         {"pin", 0, 0, 'p'},
+                                         {"dist", 1, 0, 'd'},
+                                         {"sweep", 0, 0, 's'},
+                                         {"help", 0, 0, '?'},
+                                         {0, 0, 0, 0}};
+
+  while ((opt = getopt_long(argc, argv, "n:pd:s?", long_options, NULL)) != EOF) {
+
+    switch (opt) {
+    case 'n':
+      numThreads = atoi(optarg);
+      break;
+    case 'p':
+      pinThreads = true;
+      break;
+    case 'd': {
+      firstDist = 0;
+      lastDist = numDists - 1;
+      if (strcmp(optarg, "all") != 0) {
+        while (firstDist < numDists && strcmp(optarg, distNames[firstDist]))
+          firstDist++;
+        if (firstDist == numDists) {
+          fprintf(stderr, "Unknown distribution %s\n", optarg);
+          return 1;
+        }
+        lastDist = firstDist;
+      }
+      break;
+    }
+    case 's':
+      sweep = true;
+      break;
+    case '?':
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  // end parsing of commandline options
+
+  if (numThreads > 0 || pinThreads) {
+    ISPCInitTaskSystem(numThreads, pinThreads);
+    printf("[ispc task system]:\t\t[%d] threads%s\n", ISPCTaskSystemThreads(),
+           pinThreads ? ", pinned" : "");
+  }
 
   const unsigned int N = 20 * 1000 * 1000;
   const float initialGuess = 1.0f;
@@ -26,78 +174,138 @@ int main() {
   float *values = new float[N];
   float *output = new float[N];
   float *gold = new float[N];
+  float *serial = new float[N];
+  double speedups[numDists][4];
 
-  for (unsigned int i = 0; i < N; i++) {
-    // TODO: CS149 students.  Attempt to change the values in the
-    // array here to meet the instructions in the handout: we want
-    // to you generate best and worse-case speedups
+  for (int dist = firstDist; dist <= lastDist; dist++) {
+    if (firstDist != lastDist)
+      printf("[%s values]\n", distNames[dist]);
 
-    // starter code populates array with random input values
-    values[i] = .001f + 2.998f * static_cast<float>(rand()) / RAND_MAX;
-    // values[i] = 2.9999f;
-  }
+    fillValues(dist, N, values);
 
-  // generate a gold version to check results
-  for (unsigned int i = 0; i < N; i++)
-    gold[i] = sqrt(values[i]);
-
-  //
-  // And run the serial implementation 3 times, again reporting the
-  // minimum time.
-  //
-  double minSerial = 1e30;
-  for (int i = 0; i < 3; ++i) {
-    double startTime = CycleTimer::currentSeconds();
-    sqrtSerial(N, initialGuess, values, output);
-    double endTime = CycleTimer::currentSeconds();
-    minSerial = std::min(minSerial, endTime - startTime);
-  }
+    // generate a gold version to check results
+    for (unsigned int i = 0; i < N; i++)
+      gold[i] = sqrt(values[i]);
+
+    if (sweep) {
+      sweepTaskCounts(N, initialGuess, values, output, gold);
+      continue;
+    }
 
-  printf("[sqrt serial]:\t\t[%.3f] ms\n", minSerial * 1000);
+    //
+    // And run the serial implementation 3 times, again reporting the
+    // minimum time.
+    //
+    double minSerial = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      sqrtSerial(N, initialGuess, values, serial);
+      double endTime = CycleTimer::currentSeconds();
+      minSerial = std::min(minSerial, endTime - startTime);
+    }
 
-  verifyResult(N, output, gold);
+    printf("[sqrt serial]:\t\t[%.3f] ms\n", minSerial * 1000);
 
-  //
-  // Compute the image using the ispc implementation; report the minimum
-  // time of three runs.
-  //
-  double minISPC = 1e30;
-  for (int i = 0; i < 3; ++i) {
-    double startTime = CycleTimer::currentSeconds();
-    sqrt_ispc(N, initialGuess, values, output);
-    double endTime = CycleTimer::currentSeconds();
-    minISPC = std::min(minISPC, endTime - startTime);
-  }
+    verifyResult(N, serial, gold);
 
-  printf("[sqrt ispc]:\t\t[%.3f] ms\n", minISPC * 1000);
+    //
+    // Compute the image using the ispc implementation; report the
+    // minimum time of three runs.
+    //
+    double minISPC = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      sqrt_ispc(N, initialGuess, values, output);
+      double endTime = CycleTimer::currentSeconds();
+      minISPC = std::min(minISPC, endTime - startTime);
+    }
 
-  verifyResult(N, output, gold);
+    printf("[sqrt ispc]:\t\t[%.3f] ms\n", minISPC * 1000);
 
-  // Clear out the buffer
-  for (unsigned int i = 0; i < N; ++i)
-    output[i] = 0;
+    verifyResult(N, output, gold);
 
-  //
-  // Tasking version of the ISPC code
-  //
-  double minTaskISPC = 1e30;
-  for (int i = 0; i < 3; ++i) {
-    double startTime = CycleTimer::currentSeconds();
-    sqrt_ispc_withtasks(N, initialGuess, values, output);
-    double endTime = CycleTimer::currentSeconds();
-    minTaskISPC = std::min(minTaskISPC, endTime - startTime);
-  }
+    // Clear out the buffer
+    for (unsigned int i = 0; i < N; ++i)
+      output[i] = 0;
+
+    //
+    // Tasking version of the ISPC code
+    //
+    double minTaskISPC = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      sqrt_ispc_withtasks(N, initialGuess, values, output, 0);
+      double endTime = CycleTimer::currentSeconds();
+      minTaskISPC = std::min(minTaskISPC, endTime - startTime);
+    }
+
+    printf("[sqrt task ispc]:\t[%.3f] ms\n", minTaskISPC * 1000);
 
-  printf("[sqrt task ispc]:\t[%.3f] ms\n", minTaskISPC * 1000);
+    verifyResult(N, output, gold);
 
-  verifyResult(N, output, gold);
+    for (unsigned int i = 0; i < N; ++i)
+      output[i] = 0;
 
-  printf("\t\t\t\t(%.2fx speedup from ISPC)\n", minSerial / minISPC);
-  printf("\t\t\t\t(%.2fx speedup from task ISPC)\n", minSerial / minTaskISPC);
+    //
+    // ISPC code on the values sorted into bins of about the same
+    // iteration count
+    //
+    double minBinned = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      sqrtBinned(N, initialGuess, values, output);
+      double endTime = CycleTimer::currentSeconds();
+      minBinned = std::min(minBinned, endTime - startTime);
+    }
+
+    printf("[sqrt binned ispc]:\t[%.3f] ms\n", minBinned * 1000);
+
+    verifyResult(N, output, gold);
+
+    for (unsigned int i = 0; i < N; ++i)
+      output[i] = 0;
+
+    //
+    // ISPC code seeded from the hardware rsqrt estimate, with a single
+    // Newton step
+    //
+    double minRsqrt = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      sqrt_ispc_rsqrt(N, values, output);
+      double endTime = CycleTimer::currentSeconds();
+      minRsqrt = std::min(minRsqrt, endTime - startTime);
+    }
+
+    printf("[sqrt rsqrt ispc]:\t[%.3f] ms\n", minRsqrt * 1000);
+
+    verifyRelative(N, output, serial);
+
+    printf("\t\t\t\t(%.2fx speedup from ISPC)\n", minSerial / minISPC);
+    printf("\t\t\t\t(%.2fx speedup from task ISPC)\n",
+           minSerial / minTaskISPC);
+    printf("\t\t\t\t(%.2fx speedup from binned ISPC, %.2fx of ISPC)\n",
+           minSerial / minBinned, minISPC / minBinned);
+    printf("\t\t\t\t(%.2fx speedup from rsqrt ISPC)\n", minSerial / minRsqrt);
+
+    speedups[dist][0] = minSerial / minISPC;
+    speedups[dist][1] = minSerial / minTaskISPC;
+    speedups[dist][2] = minSerial / minBinned;
+    speedups[dist][3] = minSerial / minRsqrt;
+  }
+
+  if (firstDist != lastDist && !sweep) {
+    printf("[speedup over serial]:\tispc\ttasks\tbinned\trsqrt\n");
+    for (int dist = firstDist; dist <= lastDist; dist++)
+      printf("  %-8s\t\t%.2fx\t%.2fx\t%.2fx\t%.2fx\n", distNames[dist],
+             speedups[dist][0], speedups[dist][1], speedups[dist][2],
+             speedups[dist][3]);
+  }
 
   delete[] values;
   delete[] output;
   delete[] gold;
+  delete[] serial;
 
   return 0;
 }
@@ -0,0 +1,112 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "sqrt_ispc.h"
+
+// The Newton iteration in sqrt_ispc runs until every lane of a gang has
+// converged, so a gang costs as much as its slowest element. How many
+// iterations an element takes depends only on r = x * initialGuess^2,
+// and smoothly so, except right around r = 1. Elements whose r has the
+// same exponent and top three mantissa bits (eighths of an octave)
+// therefore take about the same number of iterations.
+//
+// sqrtBinned works through the input in blocks that fit in the L1 and
+// L2 caches. Pass one counts the elements of each bin of r, pass two
+// sorts the block by bin into a local buffer, which sqrt_ispc then runs
+// on, so that gangs see elements of one bin, and the results are
+// scattered back to their original positions. Sorting the whole input
+// at once would give more coherent gangs, but its scattered accesses to
+// memory cost more than the divergence they save.
+
+static const int kBlockSize = 8 * 1024;
+
+// Eighths of an octave of r from 2^-16 to 2^16; r outside that range
+// goes to the first or last bin
+static const int kNumBins = 256;
+static const int kFirstBinBits = (127 - 16) << 3; // bits of 2^-16 >> 20
+
+// Both passes cycle through kWays copies of the bin counters, so that
+// runs of elements in the same bin do not wait on one counter
+static const int kWays = 4;
+
+static inline int sqrtBin(float x, float guess2)
+{
+    float r = x * guess2;
+    int32_t bits;
+    memcpy(&bits, &r, sizeof(bits));
+    int bin = (bits >> 20) - kFirstBinBits;
+    return bin < 0 ? 0 : (bin >= kNumBins ? kNumBins - 1 : bin);
+}
+
+//
+// sqrtBinned --
+//
+// Same results as sqrt_ispc.
+void sqrtBinned(int N,
+                float initialGuess,
+                float values[],
+                float output[])
+{
+    float guess2 = initialGuess * initialGuess;
+    uint8_t bin[kBlockSize];
+    float sorted[kBlockSize];
+    uint16_t index[kBlockSize];
+
+    for (int start=0; start<N; start+=kBlockSize) {
+        int n = N - start < kBlockSize ? N - start : kBlockSize;
+        float *blockValues = values + start;
+        float *blockOutput = output + start;
+
+        // pass one: count the elements of each bin (the bins of a block
+        // are computed in a loop of their own, which vectorizes)
+        for (int i=0; i<n; i++)
+            bin[i] = sqrtBin(blockValues[i], guess2);
+
+        int next[kWays][kNumBins] = {{0}};
+        int i = 0;
+        for (; i+kWays<=n; i+=kWays)
+            for (int w=0; w<kWays; w++)
+                next[w][bin[i + w]]++;
+        for (; i<n; i++)
+            next[0][bin[i]]++;
+
+        // turn the counts into the position of the next element of each
+        // bin and way; a block of one bin is coherent as it is
+        bool oneBin = false;
+        int pos = 0;
+        for (int b=0; b<kNumBins; b++) {
+            int binStart = pos;
+            for (int w=0; w<kWays; w++) {
+                int count = next[w][b];
+                next[w][b] = pos;
+                pos += count;
+            }
+            oneBin |= pos - binStart == n;
+        }
+        if (oneBin) {
+            ispc::sqrt_ispc(n, initialGuess, blockValues, blockOutput);
+            continue;
+        }
+
+        // pass two: sort by bin, remembering where each element came from
+        for (i=0; i+kWays<=n; i+=kWays) {
+            for (int w=0; w<kWays; w++) {
+                int p = next[w][bin[i + w]]++;
+                sorted[p] = blockValues[i + w];
+                index[p] = i + w;
+            }
+        }
+        for (; i<n; i++) {
+            int p = next[0][bin[i]]++;
+            sorted[p] = blockValues[i];
+            index[p] = i;
+        }
+
+        // sqrt_ispc reads each element before writing its result, so it
+        // can work in place
+        ispc::sqrt_ispc(n, initialGuess, sorted, sorted);
+
+        for (int k=0; k<n; k++)
+            blockOutput[index[k]] = sorted[k];
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef _FUSED_H
+#define _FUSED_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Fused elementwise (BLAS-1) expressions.
+//
+// Chaining saxpy calls, e.g. z = a x + y followed by w = b z + x, makes
+// a full pass over memory per call, and every pass re-reads what the one
+// before wrote. Here the operators on fusedArray() and float build an
+// expression tree instead of computing anything, and fusedEvaluate()
+// computes one or more fusedAssign()s in a single pass: every element
+// of every input is loaded once, and every output is stored once.
+//
+//   FusedArray x = fusedArray(X), y = fusedArray(Y);
+//   auto z = a * x + y;
+//   fusedEvaluate(N, numThreads, fusedAssign(W, b * z + x));
+//
+// computes w without writing z to memory at all; adding
+// fusedAssign(Z, z) also stores z, still in the same pass.
+//
+// Nodes hold their operands by value (arrays are pointers), so an
+// expression can outlive the temporaries it was built from. Evaluation
+// splits the elements over numThreads threads; each thread runs a plain
+// loop over its range that the compiler vectorizes. Within an element,
+// the assignments run in the order given, so a later one may read an
+// array an earlier one wrote. Arithmetic is done exactly as written,
+// so a fused a * x + y gives the same bits as saxpySerial.
+
+template <class E> struct FusedExpr {
+  const E &self() const { return static_cast<const E &>(*this); }
+};
+
+struct FusedArray : FusedExpr<FusedArray> {
+  const float *p;
+  explicit FusedArray(const float *p) : p(p) {}
+  float operator[](long i) const { return p[i]; }
+};
+
+struct FusedScalar : FusedExpr<FusedScalar> {
+  float v;
+  explicit FusedScalar(float v) : v(v) {}
+  float operator[](long) const { return v; }
+};
+
+struct FusedAdd {
+  static float apply(float a, float b) { return a + b; }
+};
+struct FusedSub {
+  static float apply(float a, float b) { return a - b; }
+};
+struct FusedMul {
+  static float apply(float a, float b) { return a * b; }
+};
+
+template <class Op, class L, class R>
+struct FusedBinary : FusedExpr<FusedBinary<Op, L, R>> {
+  L l;
+  R r;
+  FusedBinary(const L &l, const R &r) : l(l), r(r) {}
+  float operator[](long i) const { return Op::apply(l[i], r[i]); }
+};
+
+inline FusedArray fusedArray(const float *p) { return FusedArray(p); }
+
+// expression op expression, float op expression and expression op float
+#define FUSED_OPERATOR(op, Op)                                                 \
+  template <class L, class R>                                                  \
+  FusedBinary<Op, L, R> operator op(const FusedExpr<L> &l,                     \
+                                    const FusedExpr<R> &r) {                   \
+    return FusedBinary<Op, L, R>(l.self(), r.self());                          \
+  }                                                                            \
+  template <class R>                                                           \
+  FusedBinary<Op, FusedScalar, R> operator op(float l,                         \
+                                              const FusedExpr<R> &r) {         \
+    return FusedBinary<Op, FusedScalar, R>(FusedScalar(l), r.self());          \
+  }                                                                            \
+  template <class L>                                                           \
+  FusedBinary<Op, L, FusedScalar> operator op(const FusedExpr<L> &l,           \
+                                              float r) {                       \
+    return FusedBinary<Op, L, FusedScalar>(l.self(), FusedScalar(r));          \
+  }
+
+FUSED_OPERATOR(+, FusedAdd)
+FUSED_OPERATOR(-, FusedSub)
+FUSED_OPERATOR(*, FusedMul)
+
+#undef FUSED_OPERATOR
+
+template <class E> struct FusedAssign {
+  float *out;
+  E e;
+  FusedAssign(float *out, const E &e) : out(out), e(e) {}
+  void apply(long i) const { out[i] = e[i]; }
+};
+
+template <class E>
+FusedAssign<E> fusedAssign(float *out, const FusedExpr<E> &e) {
+  return FusedAssign<E>(out, e.self());
+}
+
+// Elements per step of the vectorized loop
+static const int kFusedBlock = 8;
+
+//
+// fusedEvaluateRange --
+//
+// Evaluates the assignments for elements [start, end). Elements only
+// depend on the same element of the inputs, hence ivdep; the fixed-size
+// inner loop lets the compiler vectorize it at -O2 as well.
+//
+template <class... A>
+void fusedEvaluateRange(long start, long end, const A &... assigns) {
+  long i = start;
+  for (; i + kFusedBlock <= end; i += kFusedBlock) {
+#pragma GCC ivdep
+    for (int k = 0; k < kFusedBlock; k++)
+      (assigns.apply(i + k), ...);
+  }
+  for (; i < end; i++)
+    (assigns.apply(i), ...);
+}
+
+//
+// fusedEvaluate --
+//
+// Evaluates the assignments for elements [0, N) in one pass, on
+// numThreads threads (the calling thread is one of them), each over a
+// contiguous range of a multiple of 16 elements (a cache line of
+// floats), so threads do not share lines of aligned outputs.
+//
+template <class... A>
+void fusedEvaluate(long N, int numThreads, const A &... assigns) {
+  numThreads = std::max(1, numThreads);
+  long span = (N + numThreads - 1) / numThreads;
+  span = (span + 15) / 16 * 16;
+
+  std::vector<std::thread> workers;
+  for (long start = span; start < N; start += span)
+    workers.push_back(std::thread([=] {
+      fusedEvaluateRange(start, std::min(start + span, N), assigns...);
+    }));
+  fusedEvaluateRange(0, std::min(span, N), assigns...);
+  for (auto &w : workers)
+    w.join();
+}
+
+#endif
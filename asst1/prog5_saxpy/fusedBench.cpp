@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "CycleTimer.h"
+#include "fused.h"
+#include "saxpy_ispc.h"
+
+using namespace ispc;
+
+extern void saxpySerial(int N, float a, float *X, float *Y, float *result);
+
+// GB/s, as toBW() in main.cpp
+static double toBW(double bytes, double sec) {
+  return bytes / (1024. * 1024. * 1024.) / sec;
+}
+
+static bool sameResult(int N, float *result, float *gold) {
+  for (int i = 0; i < N; i++) {
+    if (result[i] != gold[i]) {
+      printf("Error: [%d] Got %f expected %f\n", i, result[i], gold[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// saxpy_ispc may use fused multiply-adds, which round differently from
+// saxpySerial, so its results are checked to a relative tolerance, as
+// verifyRelative() in prog4
+static bool closeResult(int N, float *result, float *gold) {
+  for (int i = 0; i < N; i++) {
+    if (fabsf(result[i] - gold[i]) > 1e-5f * fabsf(gold[i])) {
+      printf("Error: [%d] Got %f expected %f\n", i, result[i], gold[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+// timeRuns --
+//
+// Minimum time of three runs of run().
+//
+template <class F> static double timeRuns(F run) {
+  double minTime = 1e30;
+  for (int i = 0; i < 3; ++i) {
+    double startTime = CycleTimer::currentSeconds();
+    run();
+    double endTime = CycleTimer::currentSeconds();
+    minTime = std::min(minTime, endTime - startTime);
+  }
+  return minTime;
+}
+
+static void report(const char *name, double sec, double bytes,
+                   double separateBytes) {
+  char label[80];
+  snprintf(label, sizeof(label), "[%s]:", name);
+  printf("%-28s[%.3f] ms\t[%.3f] GB/s\t%.0f MB moved, %.0f MB saved\n",
+         label, sec * 1000, toBW(bytes, sec), bytes / (1024 * 1024),
+         (separateBytes - bytes) / (1024 * 1024));
+}
+
+//
+// runFusedBenchmark --
+//
+// Computes z = a x + y, w = b z + x with two saxpy calls, and fused in
+// one pass with fused.h, on one core and on numThreads threads. Bytes
+// moved count the read for ownership of every written line, as in
+// main.cpp, so each stored array costs 8 bytes per element and each
+// loaded one 4:
+//
+//   separate saxpys           x, y -> z; z, x -> w     32 bytes
+//   fused, z and w stored     x, y -> z, w             24 bytes
+//   fused, z a temporary      x, y -> w                16 bytes
+//
+int runFusedBenchmark(int numThreads) {
+  const int N = 20 * 1000 * 1000;
+  const float a = 2.f, b = 3.f;
+  const double separateBytes = 32. * N;
+  const double fusedBytes = 24. * N;
+  const double fusedTempBytes = 16. * N;
+
+  size_t bytes = (N * sizeof(float) + 63) / 64 * 64;
+  float *X = (float *)aligned_alloc(64, bytes);
+  float *Y = (float *)aligned_alloc(64, bytes);
+  float *Z = (float *)aligned_alloc(64, bytes);
+  float *W = (float *)aligned_alloc(64, bytes);
+  float *goldZ = (float *)aligned_alloc(64, bytes);
+  float *goldW = (float *)aligned_alloc(64, bytes);
+
+  for (int i = 0; i < N; i++) {
+    X[i] = i;
+    Y[i] = N - i;
+    Z[i] = W[i] = 0.f;
+  }
+  saxpySerial(N, a, X, Y, goldZ);
+  saxpySerial(N, b, goldZ, X, goldW);
+
+  FusedArray x = fusedArray(X), y = fusedArray(Y);
+  auto z = a * x + y;
+  auto w = b * z + x;
+
+  printf("[fused BLAS-1]:\t\tz = %.0f x + y, w = %.0f z + x on %d M "
+         "elements, %d threads\n",
+         a, b, N / 1000000, numThreads);
+
+  bool ok = true;
+  for (int threads = 1;; threads = numThreads) {
+    const char *suffix = threads == 1 ? "" : " threads";
+    char name[64];
+
+    double sec = timeRuns([&] {
+      if (threads == 1) {
+        saxpy_ispc(N, a, X, Y, Z);
+        saxpy_ispc(N, b, Z, X, W);
+      } else {
+        saxpy_ispc_withtasks(N, a, X, Y, Z, 0);
+        saxpy_ispc_withtasks(N, b, Z, X, W, 0);
+      }
+    });
+    ok = ok && closeResult(N, Z, goldZ) && closeResult(N, W, goldW);
+    snprintf(name, sizeof(name), "separate saxpy%s", suffix);
+    report(name, sec, separateBytes, separateBytes);
+
+    std::fill(Z, Z + N, 0.f);
+    std::fill(W, W + N, 0.f);
+    double fusedSec = timeRuns([&] {
+      fusedEvaluate(N, threads, fusedAssign(Z, z), fusedAssign(W, w));
+    });
+    ok = ok && sameResult(N, Z, goldZ) && sameResult(N, W, goldW);
+    snprintf(name, sizeof(name), "fused z, w%s", suffix);
+    report(name, fusedSec, fusedBytes, separateBytes);
+    printf("\t\t\t\t(%.2fx speedup from fusion)\n", sec / fusedSec);
+
+    std::fill(W, W + N, 0.f);
+    double tempSec =
+        timeRuns([&] { fusedEvaluate(N, threads, fusedAssign(W, w)); });
+    ok = ok && sameResult(N, W, goldW);
+    snprintf(name, sizeof(name), "fused w only%s", suffix);
+    report(name, tempSec, fusedTempBytes, separateBytes);
+    printf("\t\t\t\t(%.2fx speedup from fusion)\n", sec / tempSec);
+
+    if (threads == numThreads)
+      break;
+  }
+
+  free(X);
+  free(Y);
+  free(Z);
+  free(W);
+  free(goldZ);
+  free(goldW);
+
+  return ok ? 0 : 1;
+}
@@ -1,14 +1,35 @@
 #include <algorithm>
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <thread>
 
 #include "CycleTimer.h"
+#include "tasksys.h"
 #include "saxpy_ispc.h"
 
 extern void saxpySerial(int N, float a, float *X, float *Y, float *result);
 
+extern int runStreamSuite(int maxThreads);
+
+extern int runFusedBenchmark(int numThreads);
+
+extern void saxpyStream(int N, float scale, float X[], float Y[],
+                        float result[]);
+extern bool saxpyStreamSupported();
+extern bool saxpyAuto(int N, float scale, float X[], float Y[],
+                      float result[]);
+extern long long lastLevelCacheBytes();
+
+// Arrays start on a cache line, which the streaming stores of
+// saxpyStream need (it handles any misalignment in a prologue, though)
+static float *allocFloats(unsigned int N) {
+  return (float *)aligned_alloc(64, (N * sizeof(float) + 63) / 64 * 64);
+}
+
 // return GB/s
-static float toBW(int bytes, float sec) {
-  return static_cast<float>(bytes) / (1024. * 1024. * 1024.) / sec;
+static float toBW(double bytes, float sec) {
+  return static_cast<float>(bytes / (1024. * 1024. * 1024.) / sec);
 }
 
 static float toGFLOPS(int ops, float sec) {
@@ -25,19 +46,135 @@ static void verifyResult(int N, float *result, float *gold) {
 
 using namespace ispc;
 
-int main() {
+static void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("Program Options:\n");
+  printf("  -n  --threads <N>  Run ISPC tasks on N threads (default: all CPUs)\n");
+  printf("  -p  --pin          Pin ISPC task threads to CPUs\n");
+  printf("  -b  --bandwidth    Only run the STREAM bandwidth suite, on up to\n");
+  printf("                     the -n thread count (default: all CPUs)\n");
+  printf("  -f  --fused        Only compare chained saxpy calls with fused\n");
+  printf("                     expressions, on 1 and -n threads\n");
+  printf("  -s  --sweep        Only time the ISPC tasks code for a range of\n");
+  printf("                     task counts, to tune it for this machine\n");
+  printf("  -?  --help         This message\n");
+}
+
+//
+// sweepTaskCounts --
+//
+// Times saxpy_ispc_withtasks with the automatic task count and with 1,
+// 2, 4, ... tasks up to 16 per thread (and at least 64), and reports
+// the fastest count.
+static void sweepTaskCounts(int N, float scale, float *X, float *Y,
+                            float *result, float *gold, double totalBytes) {
+  int threads = ISPCTaskSystemThreads();
+  printf("[ispc task system]:\t\t[%d] threads\n", threads);
+
+  int maxTasks = std::min(N, std::max(64, 16 * threads));
+  int bestTasks = 0;
+  double bestTime = 1e30, autoTime = 0;
+  for (int numTasks = 0; numTasks <= maxTasks;
+       numTasks = numTasks > 0 ? 2 * numTasks : 1) {
+    double minTime = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      saxpy_ispc_withtasks(N, scale, X, Y, result, numTasks);
+      double endTime = CycleTimer::currentSeconds();
+      minTime = std::min(minTime, endTime - startTime);
+    }
+    verifyResult(N, result, gold);
+
+    if (numTasks == 0) {
+      printf("[tasks auto]:\t\t[%.3f] ms\t[%.3f] GB/s\n", minTime * 1000,
+             toBW(totalBytes, minTime));
+      autoTime = minTime;
+    } else {
+      printf("[tasks %d]:\t\t[%.3f] ms\t[%.3f] GB/s\n", numTasks,
+             minTime * 1000, toBW(totalBytes, minTime));
+      if (minTime < bestTime) {
+        bestTime = minTime;
+        bestTasks = numTasks;
+      }
+    }
+  }
+
+  printf("[best]:\t\t\t%d tasks, [%.3f] ms (%.2fx of auto)\n", bestTasks,
+         bestTime * 1000, autoTime / bestTime);
+}
+
+int main(int argc, char **argv) {
+
+  int numThreads = 0;
+  bool pinThreads = false;
+  bool sweep = false;
+  bool bandwidth = false;
+  bool fused = false;
+
+  // parse commandline options ////////////////////////////////////////////
+  int opt;
+  static struct option long_options[] = {{"threads", 1, 0, 'n'},
+                                         {"pin", 0, 0, 'p'},
+                                         {"sweep", 0, 0, 's'},
+                                         {"bandwidth", 0, 0, 'b'},
+                                         {"fused", 0, 0, 'f'},
+                                         {"help", 0, 0, '?'},
+                                         {0, 0, 0, 0}};
+
+  while ((opt = getopt_long(argc, argv, "n:psbf?", long_options, NULL)) != EOF) {
+
+    switch (opt) {
+    case 'n':
+      numThreads = atoi(optarg);
+      break;
+    case 'p':
+      pinThreads = true;
+      break;
+    case 's':
+      sweep = true;
+      break;
+    case 'b':
+      bandwidth = true;
+      break;
+    case 'f':
+      fused = true;
+      break;
+    case '?':
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  // end parsing of commandline options
+
+  if (numThreads > 0 || pinThreads) {
+    ISPCInitTaskSystem(numThreads, pinThreads);
+    printf("[ispc task system]:\t\t[%d] threads%s\n", ISPCTaskSystemThreads(),
+           pinThreads ? ", pinned" : "");
+  }
+
+  if (bandwidth || fused) {
+    int maxThreads = numThreads > 0 ? numThreads
+                                    : std::thread::hardware_concurrency();
+    maxThreads = std::max(1, maxThreads);
+    return bandwidth ? runStreamSuite(maxThreads)
+                     : runFusedBenchmark(maxThreads);
+  }
 
   const unsigned int N = 20 * 1000 * 1000; // 20 M element vectors (~80 MB)
-  const unsigned int TOTAL_BYTES = 4 * N * sizeof(float);
+  // X and Y are read and result written, and result is also read before
+  // it is written: the cache fetches each line for ownership first
+  // (write-allocate). See -b for the traffic with and without it.
+  const double TOTAL_BYTES = 4. * N * sizeof(float);
   const unsigned int TOTAL_FLOPS = 2 * N;
 
   float scale = 2.f;
 
-  float *arrayX = new float[N];
-  float *arrayY = new float[N];
-  float *resultSerial = new float[N];
-  float *resultISPC = new float[N];
-  float *resultTasks = new float[N];
+  float *arrayX = allocFloats(N);
+  float *arrayY = allocFloats(N);
+  float *resultSerial = allocFloats(N);
+  float *resultISPC = allocFloats(N);
+  float *resultTasks = allocFloats(N);
 
   // initialize array values
   for (unsigned int i = 0; i < N; i++) {
@@ -60,6 +197,17 @@ int main() {
     minSerial = std::min(minSerial, endTime - startTime);
   }
 
+  if (sweep) {
+    sweepTaskCounts(N, scale, arrayX, arrayY, resultTasks, resultSerial,
+                    TOTAL_BYTES);
+    free(arrayX);
+    free(arrayY);
+    free(resultSerial);
+    free(resultISPC);
+    free(resultTasks);
+    return 0;
+  }
+
   // printf("[saxpy serial]:\t\t[%.3f] ms\t[%.3f] GB/s\t[%.3f] GFLOPS\n",
   //       minSerial * 1000,
   //       toBW(TOTAL_BYTES, minSerial),
@@ -88,7 +236,7 @@ int main() {
   double minTaskISPC = 1e30;
   for (int i = 0; i < 3; ++i) {
     double startTime = CycleTimer::currentSeconds();
-    saxpy_ispc_withtasks(N, scale, arrayX, arrayY, resultTasks);
+    saxpy_ispc_withtasks(N, scale, arrayX, arrayY, resultTasks, 0);
     double endTime = CycleTimer::currentSeconds();
     minTaskISPC = std::min(minTaskISPC, endTime - startTime);
   }
@@ -100,14 +248,48 @@ int main() {
          toGFLOPS(TOTAL_FLOPS, minTaskISPC));
 
   printf("\t\t\t\t(%.2fx speedup from use of tasks)\n", minISPC / minTaskISPC);
+
+  //
+  // Run the single-core version with streaming stores, which skips the
+  // read for ownership of result: 12 instead of 16 bytes of traffic per
+  // element. GB/s are counted as above, so they compare directly.
+  //
+  if (saxpyStreamSupported()) {
+    for (unsigned int i = 0; i < N; ++i)
+      resultISPC[i] = 0.f;
+
+    double minStream = 1e30;
+    for (int i = 0; i < 3; ++i) {
+      double startTime = CycleTimer::currentSeconds();
+      saxpyStream(N, scale, arrayX, arrayY, resultISPC);
+      double endTime = CycleTimer::currentSeconds();
+      minStream = std::min(minStream, endTime - startTime);
+    }
+
+    verifyResult(N, resultISPC, resultSerial);
+
+    printf("[saxpy streaming]:\t[%.3f] ms\t[%.3f] GB/s\t[%.3f] GFLOPS\n",
+           minStream * 1000, toBW(TOTAL_BYTES, minStream),
+           toGFLOPS(TOTAL_FLOPS, minStream));
+    printf("\t\t\t\t(%.2fx speedup from streaming stores, +%.3f GB/s)\n",
+           minISPC / minStream,
+           toBW(TOTAL_BYTES, minStream) - toBW(TOTAL_BYTES, minISPC));
+
+    bool streamed = saxpyAuto(N, scale, arrayX, arrayY, resultISPC);
+    verifyResult(N, resultISPC, resultSerial);
+    printf("\t\t\t\t(saxpyAuto: %.0f MB of arrays, %.0f MB LLC: %s)\n",
+           3. * N * sizeof(float) / (1024 * 1024),
+           lastLevelCacheBytes() / (1024. * 1024.),
+           streamed ? "streaming stores" : "saxpy_ispc");
+  }
   // printf("\t\t\t\t(%.2fx speedup from ISPC)\n", minSerial/minISPC);
   // printf("\t\t\t\t(%.2fx speedup from task ISPC)\n", minSerial/minTaskISPC);
 
-  delete[] arrayX;
-  delete[] arrayY;
-  delete[] resultSerial;
-  delete[] resultISPC;
-  delete[] resultTasks;
+  free(arrayX);
+  free(arrayY);
+  free(resultSerial);
+  free(resultISPC);
+  free(resultTasks);
 
   return 0;
 }
@@ -0,0 +1,78 @@
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "saxpy_ispc.h"
+
+//
+// saxpy with non-temporal (streaming) stores.
+//
+// An ordinary store first reads the line it writes into the cache (read
+// for ownership), so saxpy moves 16 bytes per element: X, Y and result
+// read, result written. A streaming store writes whole lines straight
+// to memory through the write-combining buffers, saving the fourth of
+// the traffic that the read of result costs. It also evicts result from
+// the cache, which is a loss when the arrays would fit there, so
+// saxpyAuto only uses it past the last-level cache.
+//
+// The arithmetic is the same as saxpySerial (no fused multiply-add), so
+// the results are bit-identical.
+//
+
+extern long long lastLevelCacheBytes();
+
+__attribute__((target("avx"))) void saxpyStream(int N, float scale,
+                                                  float X[], float Y[],
+                                                  float result[]) {
+  int i = 0;
+
+  // prologue: plain stores up to the first 32-byte aligned element of
+  // result, which streaming stores require
+  while (i < N && ((uintptr_t)(result + i) & 31) != 0) {
+    result[i] = scale * X[i] + Y[i];
+    i++;
+  }
+
+  const __m256 s = _mm256_set1_ps(scale);
+  for (; i + 8 <= N; i += 8) {
+    __m256 x = _mm256_loadu_ps(X + i);
+    __m256 y = _mm256_loadu_ps(Y + i);
+    _mm256_stream_ps(result + i, _mm256_add_ps(_mm256_mul_ps(s, x), y));
+  }
+
+  // epilogue: the last N % 8 elements
+  for (; i < N; i++)
+    result[i] = scale * X[i] + Y[i];
+
+  // streaming stores are weakly ordered; make them visible to other
+  // threads before returning
+  _mm_sfence();
+}
+
+//
+// saxpyStreamSupported --
+//
+// Whether the CPU has AVX, checked through CPUID.
+//
+bool saxpyStreamSupported() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx");
+}
+
+//
+// saxpyAuto --
+//
+// saxpy with streaming stores when the three arrays together exceed the
+// last-level cache, and saxpy_ispc otherwise. Returns whether it
+// streamed.
+//
+bool saxpyAuto(int N, float scale, float X[], float Y[], float result[]) {
+  static const long long llc = lastLevelCacheBytes();
+  static const bool supported = saxpyStreamSupported();
+
+  if (supported && 3LL * N * (long long)sizeof(float) > llc) {
+    saxpyStream(N, scale, X, Y, result);
+    return true;
+  }
+  ispc::saxpy_ispc(N, scale, X, Y, result);
+  return false;
+}
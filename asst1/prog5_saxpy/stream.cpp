@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "CycleTimer.h"
+#include "saxpy_ispc.h"
+#include "stream_ispc.h"
+
+using namespace ispc;
+
+//
+// STREAM-style memory bandwidth suite: copy (c = a), scale (b = s c),
+// add (c = a + b) and triad (a = b + s c, i.e. saxpy), for array sizes
+// from L1-resident to several times the last-level cache, and for a
+// range of thread counts.
+//
+// Every thread owns a fixed slice of the arrays. It initializes the
+// slice itself, so first-touch page placement puts the pages on its
+// NUMA node, and it runs every kernel on that slice only.
+//
+// Bandwidth is given twice. The first figure counts the bytes the
+// kernel reads and writes (the STREAM convention). The second adds the
+// read for ownership of every written cache line, which a write-allocate
+// cache issues before the write, and which is what actually crosses the
+// memory bus once the arrays no longer fit in the caches.
+//
+
+enum StreamKernel { COPY, SCALE, ADD, TRIAD, NUM_KERNELS };
+
+static const char *kernelNames[NUM_KERNELS] = {"copy", "scale", "add",
+                                               "triad"};
+
+// bytes read and written per element, without write-allocate
+static const int kernelBytes[NUM_KERNELS] = {8, 8, 12, 12};
+
+// bytes per element each kernel writes, and so also reads for ownership
+static const int kWrittenBytes = 4;
+
+static const int kNumTrials = 5;
+
+// Small arrays are run repeatedly within a trial, so that each trial
+// moves at least this much data and lasts long enough to time
+static const double kMinTrialBytes = 128. * 1024 * 1024;
+
+static const float kScale = 3.f;
+
+// GB/s, as toBW() in main.cpp
+static double toBW(double bytes, double sec) {
+  return bytes / (1024. * 1024. * 1024.) / sec;
+}
+
+//
+// lastLevelCacheBytes --
+//
+// Size of the last-level cache, or 32 MB if the system does not say.
+//
+long long lastLevelCacheBytes() {
+  long bytes = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (bytes <= 0)
+    bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  return bytes > 0 ? bytes : 32LL * 1024 * 1024;
+}
+
+typedef struct {
+  int threadId;
+  int numThreads;
+  long long N;
+  float *a, *b, *c;
+  int reps;
+  pthread_barrier_t *barrier;
+  double *minTime; // [NUM_KERNELS], written by thread 0
+} StreamArgs;
+
+void streamThreadStart(StreamArgs *const args) {
+  long long start = args->N * args->threadId / args->numThreads;
+  int n = args->N * (args->threadId + 1) / args->numThreads - start;
+  float *a = args->a + start, *b = args->b + start, *c = args->c + start;
+
+  // first touch
+  for (int i = 0; i < n; i++) {
+    a[i] = 1.f;
+    b[i] = 2.f;
+    c[i] = 0.f;
+  }
+
+  for (int k = 0; k < NUM_KERNELS; k++) {
+    for (int trial = 0; trial < kNumTrials; trial++) {
+      pthread_barrier_wait(args->barrier);
+      double startTime = CycleTimer::currentSeconds();
+
+      for (int r = 0; r < args->reps; r++) {
+        switch (k) {
+        case COPY:
+          stream_copy_ispc(n, a, c);
+          break;
+        case SCALE:
+          stream_scale_ispc(n, kScale, c, b);
+          break;
+        case ADD:
+          stream_add_ispc(n, a, b, c);
+          break;
+        case TRIAD:
+          saxpy_ispc(n, kScale, c, b, a);
+          break;
+        }
+      }
+
+      pthread_barrier_wait(args->barrier);
+      if (args->threadId == 0)
+        args->minTime[k] = std::min(args->minTime[k],
+                                    CycleTimer::currentSeconds() - startTime);
+    }
+  }
+}
+
+//
+// runStream --
+//
+// Times the kernels on arrays of N floats with numThreads threads.
+// Returns the best time of each kernel for one pass over the arrays.
+//
+static void runStream(int numThreads, long long N, double minTime[]) {
+  size_t bytes = (N * sizeof(float) + 63) / 64 * 64;
+  float *a = (float *)aligned_alloc(64, bytes);
+  float *b = (float *)aligned_alloc(64, bytes);
+  float *c = (float *)aligned_alloc(64, bytes);
+
+  int reps = std::max(1.0, kMinTrialBytes / (12. * N));
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, numThreads);
+
+  for (int k = 0; k < NUM_KERNELS; k++)
+    minTime[k] = 1e30;
+
+  std::vector<std::thread> workers(numThreads);
+  std::vector<StreamArgs> args(numThreads);
+  for (int i = 0; i < numThreads; i++) {
+    args[i].threadId = i;
+    args[i].numThreads = numThreads;
+    args[i].N = N;
+    args[i].a = a;
+    args[i].b = b;
+    args[i].c = c;
+    args[i].reps = reps;
+    args[i].barrier = &barrier;
+    args[i].minTime = minTime;
+  }
+
+  // Thread 0 is the calling thread, as in prog1
+  for (int i = 1; i < numThreads; i++)
+    workers[i] = std::thread(streamThreadStart, &args[i]);
+  streamThreadStart(&args[0]);
+  for (int i = 1; i < numThreads; i++)
+    workers[i].join();
+
+  pthread_barrier_destroy(&barrier);
+  for (int k = 0; k < NUM_KERNELS; k++)
+    minTime[k] /= reps;
+
+  free(a);
+  free(b);
+  free(c);
+}
+
+//
+// runStreamSuite --
+//
+// Runs the suite for 1, 2, 4, ... and maxThreads threads and prints the
+// bandwidth of every kernel at every size, and the DRAM bandwidth the
+// largest arrays reach, which is the ceiling for memory-bound kernels.
+//
+int runStreamSuite(int maxThreads) {
+  long long llc = lastLevelCacheBytes();
+
+  // from 4 KB per array up to at least 4x the LLC for all three arrays
+  // together, and at least 64 MB per array
+  long long minN = 1024;
+  long long maxBytes = std::max(4 * llc / 3, 64LL * 1024 * 1024);
+  long long maxN = minN;
+  while (maxN * (long long)sizeof(float) < maxBytes)
+    maxN *= 2;
+
+  printf("[stream suite]:\t\tLLC %.1f MB, arrays of 4 KB to %lld MB, up to "
+         "%d threads\n",
+         llc / (1024. * 1024.), maxN * (long long)sizeof(float) >> 20,
+         maxThreads);
+  printf("\t\t\tGB/s counting the bytes each kernel reads and writes, and\n"
+         "\t\t\t(in parentheses) adding the read for ownership of each\n"
+         "\t\t\twritten line: copy and scale move %d (%d) bytes per\n"
+         "\t\t\telement, add and triad %d (%d)\n",
+         kernelBytes[COPY], kernelBytes[COPY] + kWrittenBytes,
+         kernelBytes[TRIAD], kernelBytes[TRIAD] + kWrittenBytes);
+
+  for (int numThreads = 1;;) {
+    printf("[%d thread%s]\n  size/array", numThreads,
+           numThreads > 1 ? "s" : "");
+    for (int k = 0; k < NUM_KERNELS; k++)
+      printf("  %-14s", kernelNames[k]);
+    printf("\n");
+
+    double minTime[NUM_KERNELS];
+    for (long long N = std::max(minN, (long long)numThreads); N <= maxN;
+         N *= 2) {
+      runStream(numThreads, N, minTime);
+
+      double kb = N * sizeof(float) / 1024.;
+      if (kb < 1024)
+        printf("  %6.0f KB ", kb);
+      else
+        printf("  %6.0f MB ", kb / 1024);
+      for (int k = 0; k < NUM_KERNELS; k++)
+        printf("  %6.1f (%5.1f)", toBW(kernelBytes[k] * N, minTime[k]),
+               toBW((kernelBytes[k] + kWrittenBytes) * N, minTime[k]));
+      printf("\n");
+    }
+
+    printf("  DRAM ceiling: triad %.1f GB/s, %.1f GB/s with write-allocate\n",
+           toBW(kernelBytes[TRIAD] * maxN, minTime[TRIAD]),
+           toBW((kernelBytes[TRIAD] + kWrittenBytes) * maxN, minTime[TRIAD]));
+
+    if (numThreads == maxThreads)
+      break;
+    numThreads = std::min(2 * numThreads, maxThreads);
+  }
+
+  return 0;
+}
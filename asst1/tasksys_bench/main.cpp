@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <atomic>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "CycleTimer.h"
+
+// Microbenchmark of the ISPC task runtime in ../common/tasksys.cpp. It
+// calls the entry points that ispc-generated code uses for launch[] and
+// sync directly, with tasks that do no work, so it measures the runtime
+// alone:
+//
+//   launch:     time spent inside ISPCLaunch (queueing and waking workers)
+//   first task: time from entering ISPCLaunch until some task starts
+//   total:      launch plus ISPCSync, i.e. until all tasks have finished
+
+extern "C" {
+void ISPCLaunch(void **handlePtr, void *f, void *data, int count);
+void *ISPCAlloc(void **handlePtr, int64_t size, int32_t alignment);
+void ISPCSync(void *handle);
+}
+
+struct LaunchTimes {
+  double launch;
+  double firstTask;
+  double total;
+};
+
+static std::atomic<bool> firstTaskStarted;
+static double firstTaskTime;
+
+// Signature of ispc-generated 'task' functions
+static void emptyTask(void *data, int threadIndex, int threadCount,
+                      int taskIndex, int taskCount) {
+  if (!firstTaskStarted.load(std::memory_order_relaxed) &&
+      !firstTaskStarted.exchange(true))
+    firstTaskTime = CycleTimer::currentSeconds();
+}
+
+static LaunchTimes timeLaunch(int numTasks) {
+  LaunchTimes t;
+  void *handle = NULL;
+  firstTaskStarted = false;
+
+  double startTime = CycleTimer::currentSeconds();
+  ISPCLaunch(&handle, (void *)emptyTask, NULL, numTasks);
+  double launchTime = CycleTimer::currentSeconds();
+  ISPCSync(handle);
+  double endTime = CycleTimer::currentSeconds();
+
+  t.launch = launchTime - startTime;
+  t.firstTask = firstTaskTime - startTime;
+  t.total = endTime - startTime;
+  return t;
+}
+
+static double median(std::vector<double> &v) {
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+static void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("Program Options:\n");
+  printf("  -r  --reps <N>   Launches timed per task count (default=200)\n");
+  printf("  -w  --warm       Do not let the workers go idle between launches\n");
+  printf("  -?  --help       This message\n");
+}
+
+int main(int argc, char **argv) {
+
+  int reps = 200;
+  bool warm = false;
+
+  int opt;
+  static struct option long_options[] = {{"reps", 1, 0, 'r'},
+                                         {"warm", 0, 0, 'w'},
+                                         {"help", 0, 0, '?'},
+                                         {0, 0, 0, 0}};
+  while ((opt = getopt_long(argc, argv, "r:w?", long_options, NULL)) != EOF) {
+    switch (opt) {
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 'w':
+      warm = true;
+      break;
+    case '?':
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // The first launch creates the worker threads; keep it out of the
+  // measurements.
+  timeLaunch(1);
+
+  const int taskCounts[] = {1, 8, 64, 512, 4096, 16384};
+
+  printf("%s workers (median of %d launches, us)\n", warm ? "Warm" : "Idle",
+         reps);
+  printf("%8s %12s %12s %12s %14s\n", "tasks", "launch", "first task",
+         "total", "total/task ns");
+  for (int numTasks : taskCounts) {
+    std::vector<double> launch, firstTask, total;
+    for (int i = 0; i < reps; i++) {
+      // Give the workers time to run out of work and go to sleep, so
+      // that the launch pays for waking them up.
+      if (!warm)
+        usleep(2000);
+      LaunchTimes t = timeLaunch(numTasks);
+      launch.push_back(t.launch);
+      firstTask.push_back(t.firstTask);
+      total.push_back(t.total);
+    }
+    double medianTotal = median(total);
+    printf("%8d %12.2f %12.2f %12.2f %14.1f\n", numTasks,
+           median(launch) * 1e6, median(firstTask) * 1e6, medianTotal * 1e6,
+           medianTotal * 1e9 / numTasks);
+  }
+
+  return 0;
+}
@@ -2,8 +2,60 @@
 #include <stdio.h>
 #include <math.h>
 #include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
 
 
+static inline unsigned char
+iterationsToGray(int iterations, int maxIterations)
+{
+    // Clamp iteration count for this pixel, then scale the value
+    // to 0-1 range.  Raise resulting value to a power (<1) to
+    // increase brightness of low iteration count
+    // pixels. a.k.a. Make things look cooler.
+
+    float mapped = pow( std::min(static_cast<float>(maxIterations),
+                                 static_cast<float>(iterations)) / 256.f, .5f);
+
+    // convert back into 0-255 range, 8-bit channels
+    return static_cast<unsigned char>(255.f * mapped);
+}
+
+// Largest iteration count with an entry in grayTable().
+static const int kMaxGrayTableIndex = 1 << 16;
+
+// Gray level of the iteration counts from 0 to maxIterations (or
+// kMaxGrayTableIndex), so that converting a pixel takes a table lookup
+// instead of a pow().
+static std::vector<unsigned char>
+grayTable(int maxIterations)
+{
+    int size = std::max(0, std::min(maxIterations, kMaxGrayTableIndex)) + 1;
+    std::vector<unsigned char> table(size);
+    for (int i = 0; i < size; i++)
+        table[i] = iterationsToGray(i, maxIterations);
+    return table;
+}
+
+// Converts iteration counts to RGB pixels through grayTable(), falling
+// back to iterationsToGray() for counts outside of the table.
+static void
+convertToRGB(const int* data, size_t numPixels,
+             const std::vector<unsigned char>& table, int maxIterations,
+             unsigned char* rgb)
+{
+    unsigned int tableSize = table.size();
+    for (size_t i = 0; i < numPixels; i++) {
+        unsigned char result = (unsigned int)data[i] < tableSize
+                                   ? table[data[i]]
+                                   : iterationsToGray(data[i], maxIterations);
+        rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = result;
+    }
+}
+
+// Images below this many pixels are converted on the calling thread.
+static const size_t kMinParallelPixels = 1 << 18;
 
 void
 writePPMImage(int* data, int width, int height, const char *filename, int maxIterations)
@@ -15,21 +67,32 @@ writePPMImage(int* data, int width, int height, const char *filename, int maxIte
     fprintf(fp, "%d %d\n", width, height);
     fprintf(fp, "255\n");
 
-    for (int i = 0; i < width*height; ++i) {
-
-        // Clamp iteration count for this pixel, then scale the value
-        // to 0-1 range.  Raise resulting value to a power (<1) to
-        // increase brightness of low iteration count
-        // pixels. a.k.a. Make things look cooler.
+    // convert all pixels into one buffer, in parallel for large images,
+    // and write it at once
+    size_t numPixels = (size_t)width * height;
+    std::vector<unsigned char> table = grayTable(maxIterations);
+    std::vector<unsigned char> rgb(3 * numPixels);
 
-        float mapped = pow( std::min(static_cast<float>(maxIterations),
-                                     static_cast<float>(data[i])) / 256.f, .5f);
+    int numThreads = 1;
+    if (numPixels >= kMinParallelPixels)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = (numPixels + numThreads - 1) / numThreads;
 
-        // convert back into 0-255 range, 8-bit channels
-        unsigned char result = static_cast<unsigned char>(255.f * mapped);
-        for (int j = 0; j < 3; ++j)
-            fputc(result, fp);
+    std::vector<std::thread> workers;
+    // rounding chunk up can leave the last threads without pixels
+    for (int t = 1; t < numThreads && t * chunk < numPixels; t++) {
+        size_t start = t * chunk;
+        size_t count = std::min(chunk, numPixels - start);
+        workers.push_back(std::thread(convertToRGB, data + start, count,
+                                      std::cref(table), maxIterations,
+                                      rgb.data() + 3 * start));
     }
+    convertToRGB(data, std::min(chunk, numPixels), table, maxIterations,
+                 rgb.data());
+    for (auto &w : workers)
+        w.join();
+
+    fwrite(rgb.data(), 1, rgb.size(), fp);
     fclose(fp);
     printf("Wrote image file %s\n", filename);
 }
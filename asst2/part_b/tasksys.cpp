@@ -1,5 +1,7 @@
 #include "tasksys.h"
 
+#include <cassert>
+
 IRunnable::~IRunnable() {}
 
 ITaskSystem::ITaskSystem(int num_threads) {}
@@ -25,7 +27,9 @@ TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(
 }
 
 TaskSystemParallelThreadPoolSleeping::~TaskSystemParallelThreadPoolSleeping() {
+  dataLock_.lock();
   killed_ = true;
+  dataLock_.unlock();
   masterCv_.notify_all();
   workerCv_.notify_all();
   for (auto &worker : workers_) {
@@ -34,68 +38,140 @@ TaskSystemParallelThreadPoolSleeping::~TaskSystemParallelThreadPoolSleeping() {
 }
 
 void TaskSystemParallelThreadPoolSleeping::work() {
-  while (!killed_) {
-    dataLock_.lock();
-
-    if (ready_.empty()) {
-      dataLock_.unlock();
-      masterCv_.notify_all();
-      std::unique_lock<std::mutex> ulk(workerLock_);
-      workerCv_.wait(ulk);
-      ulk.unlock();
-      continue;
+  while (true) {
+    std::unique_lock<std::mutex> ulk(dataLock_);
+    workerCv_.wait(ulk, [this] { return killed_ || !ready_.empty(); });
+    if (killed_) {
+      return;
     }
 
     auto [batchId, totalTasks, runnable, taskNo] = ready_.front();
     ready_.pop();
-    dataLock_.unlock();
+    ulk.unlock();
 
     runnable->runTask(taskNo, totalTasks);
-    dataLock_.lock();
-    ++progress_[batchId];
-    dataLock_.unlock();
 
-    if (progress_[batchId] >= totalTasks) {
+    ulk.lock();
+    --inFlightTasks_;
+    bool batchFinished = ++progress_[batchId] >= totalTasks;
+    bool wakeProducers = blockedProducers_ > 0;
+    ulk.unlock();
+
+    if (batchFinished) {
       checkPending(batchId);
+    } else if (wakeProducers) {
+      masterCv_.notify_all();
     }
   }
 }
 
 void TaskSystemParallelThreadPoolSleeping::checkPending(TaskID doneId) {
-  std::vector<TaskID> toReady{};
+  // Batches of zero tasks are done as soon as they are released, so
+  // retiring one batch can retire more
+  std::vector<TaskID> done{doneId};
+  bool anyReady = false;
   dataLock_.lock();
 
-  batchDone_.insert(doneId);
-  for (auto &[id, dep] : dependency_) {
-    dep.erase(doneId);
-    if (dep.empty()) {
-      toReady.push_back(id);
+  while (!done.empty()) {
+    TaskID finished = done.back();
+    done.pop_back();
+    batchDone_.insert(finished);
+    --inFlightLaunches_;
+
+    std::vector<TaskID> toReady{};
+    for (auto &[id, dep] : dependency_) {
+      dep.erase(finished);
+      if (dep.empty()) {
+        toReady.push_back(id);
+      }
     }
-  }
 
-  for (const TaskID id : toReady) {
-    dependency_.erase(id);
-    if (pending_.count(id) != 0) {
-      auto [batchId, totalTasks, runnable, ignore] = pending_.at(id);
-      for (int i = 0; i < totalTasks; ++i) {
-        ready_.emplace(batchId, totalTasks, runnable, i);
+    for (const TaskID id : toReady) {
+      dependency_.erase(id);
+      if (pending_.count(id) != 0) {
+        auto [batchId, totalTasks, runnable, ignore] = pending_.at(id);
+        for (int i = 0; i < totalTasks; ++i) {
+          ready_.emplace(batchId, totalTasks, runnable, i);
+        }
+        if (totalTasks == 0) {
+          done.push_back(batchId);
+        } else {
+          anyReady = true;
+        }
+        pending_.erase(id);
       }
-      pending_.erase(id);
     }
   }
   dataLock_.unlock();
+  if (anyReady) {
+    workerCv_.notify_all();
+  }
   masterCv_.notify_all();
 }
 
+bool TaskSystemParallelThreadPoolSleeping::fits(int numTasks) const {
+  if (inFlightLaunches_ == 0) {
+    return true;
+  }
+  if (limit_.maxLaunches_ > 0 && inFlightLaunches_ >= limit_.maxLaunches_) {
+    return false;
+  }
+  if (limit_.maxTasks_ > 0 && inFlightTasks_ + numTasks > limit_.maxTasks_) {
+    return false;
+  }
+  return true;
+}
+
+void TaskSystemParallelThreadPoolSleeping::setInFlightLimit(
+    const InFlightLimit &limit) {
+  dataLock_.lock();
+  limit_ = limit;
+  bool wakeProducers = blockedProducers_ > 0;
+  dataLock_.unlock();
+  if (wakeProducers) {
+    masterCv_.notify_all();
+  }
+}
+
+QueueOccupancy TaskSystemParallelThreadPoolSleeping::occupancy() {
+  std::lock_guard<std::mutex> lk(dataLock_);
+  QueueOccupancy ret{};
+  ret.readyTasks_ = static_cast<int>(ready_.size());
+  ret.pendingLaunches_ = static_cast<int>(pending_.size());
+  ret.inFlightTasks_ = inFlightTasks_;
+  ret.inFlightLaunches_ = inFlightLaunches_;
+  return ret;
+}
+
 void TaskSystemParallelThreadPoolSleeping::run(IRunnable *runnable,
                                                int num_total_tasks) {
-  runAsyncWithDeps(runnable, num_total_tasks, {});
+  launch(runnable, num_total_tasks, {}, true);
   sync();
 }
 
 TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(
     IRunnable *runnable, int num_total_tasks, const std::vector<TaskID> &deps) {
-  dataLock_.lock();
+  return launch(runnable, num_total_tasks, deps, false);
+}
+
+TaskID TaskSystemParallelThreadPoolSleeping::launch(
+    IRunnable *runnable, int num_total_tasks, const std::vector<TaskID> &deps,
+    bool alwaysBlock) {
+  std::unique_lock<std::mutex> ulk(dataLock_);
+  // A dependency that was never launched, such as a kWouldBlock passed
+  // back in, would never finish and so would hang sync().
+  for (const TaskID batchId : deps) {
+    assert(batchId >= 0 && batchId < nextBatchId_);
+  }
+  if (!fits(num_total_tasks)) {
+    if (!alwaysBlock && !limit_.block_) {
+      return kWouldBlock;
+    }
+    ++blockedProducers_;
+    masterCv_.wait(ulk, [&] { return fits(num_total_tasks); });
+    --blockedProducers_;
+  }
+
   TaskID ret = nextBatchId_++;
 
   std::unordered_set<TaskID> tmpDep{};
@@ -115,24 +191,23 @@ TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(
     dependency_.emplace(ret, tmpDep);
   }
   progress_.emplace(ret, 0);
-
-  dataLock_.unlock();
-  workerCv_.notify_all();
+  inFlightTasks_ += num_total_tasks;
+  ++inFlightLaunches_;
+  bool doneAlready = tmpDep.empty() && num_total_tasks == 0;
+
+  ulk.unlock();
+  if (doneAlready) {
+    // no worker will ever finish a task of it
+    checkPending(ret);
+  } else {
+    workerCv_.notify_all();
+  }
   return ret;
 }
 
 void TaskSystemParallelThreadPoolSleeping::sync() {
-  bool allDone = false;
-  while (!allDone) {
-    dataLock_.lock();
-    allDone = batchDone_.size() == progress_.size();
-    dataLock_.unlock();
-    workerCv_.notify_all();
-    std::unique_lock<std::mutex> ulk(masterLock_);
-    masterCv_.wait(ulk);
-    ulk.unlock();
-  }
-  workerCv_.notify_all();
+  std::unique_lock<std::mutex> ulk(dataLock_);
+  masterCv_.wait(ulk, [this] { return inFlightLaunches_ == 0; });
 }
 
 /*
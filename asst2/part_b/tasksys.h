@@ -29,12 +29,47 @@ struct Task {
         taskNo_(taskNo) {}
 };
 
+/*
+ * InFlightLimit: bounds on the amount of work a task system may hold at
+ * once. A bound of 0 means unlimited. Once a new launch would exceed
+ * either bound, runAsyncWithDeps() blocks until enough work has drained
+ * (block_ == true) or returns kWouldBlock without launching anything.
+ * kWouldBlock is never a valid TaskID: passing it as a dependency of a
+ * later launch is an error.
+ */
+struct InFlightLimit {
+  int maxTasks_{0};
+  int maxLaunches_{0};
+  bool block_{true};
+};
+
+/*
+ * QueueOccupancy: a snapshot of the task system's queues, so that
+ * producers can pace themselves.
+ */
+struct QueueOccupancy {
+  int readyTasks_{0};       // tasks that may start right now
+  int pendingLaunches_{0};  // launches still waiting on dependencies
+  int inFlightTasks_{0};    // tasks launched but not yet finished
+  int inFlightLaunches_{0}; // launches not yet finished
+};
+
+constexpr TaskID kWouldBlock = -1;
+
+// Lets the shared tests know that setInFlightLimit() and occupancy() exist
+#define TASKSYS_IN_FLIGHT_LIMIT
+
 class TaskSystemParallelThreadPoolSleeping : public ITaskSystem {
 private:
   int numThreads_;
   std::vector<std::thread> workers_;
   bool killed_{false};
 
+  InFlightLimit limit_{};
+  int inFlightTasks_{0};
+  int inFlightLaunches_{0};
+  int blockedProducers_{0};
+
   TaskID nextBatchId_{0};
   std::queue<Task> ready_{};
   std::unordered_map<TaskID, int> progress_{};
@@ -42,15 +77,18 @@ private:
   std::unordered_set<TaskID> batchDone_{};
   std::unordered_map<TaskID, std::unordered_set<TaskID>> dependency_{};
 
+  // Guards all of the above. Workers sleep on workerCv_ until ready_ is
+  // non-empty; sync() and blocked producers sleep on masterCv_ until a
+  // launch or task finishes.
   std::mutex dataLock_{};
-
-  std::mutex workerLock_{};
   std::condition_variable workerCv_{};
-  std::mutex masterLock_{};
   std::condition_variable masterCv_{};
 
   void work();
   void checkPending(TaskID doneId);
+  bool fits(int numTasks) const;
+  TaskID launch(IRunnable *runnable, int num_total_tasks,
+                const std::vector<TaskID> &deps, bool alwaysBlock);
 
 public:
   TaskSystemParallelThreadPoolSleeping(int num_threads);
@@ -60,6 +98,17 @@ public:
   TaskID runAsyncWithDeps(IRunnable *runnable, int num_total_tasks,
                           const std::vector<TaskID> &deps);
   void sync();
+
+  /*
+    Sets the in-flight limit applied to later runAsyncWithDeps() calls.
+    run() always blocks rather than returning kWouldBlock. A launch made
+    while nothing is in flight is always accepted, so a single launch
+    larger than maxTasks_ still runs. Blocking is only safe from threads
+    outside the pool: a task that blocks here can starve the workers that
+    would drain the queue.
+   */
+  void setInFlightLimit(const InFlightLimit &limit);
+  QueueOccupancy occupancy();
 };
 
 /*
@@ -0,0 +1,109 @@
+import argparse
+import csv
+import json
+import random
+import statistics
+import sys
+
+# Compares two sets of runtasks trials written with --output (CSV or
+# JSON lines). Trials are grouped by (test, implementation, threads).
+# For each group, the ratio of candidate to baseline median time gets a
+# bootstrap confidence interval. A group is a regression if the whole
+# interval lies above 1 + threshold, and an improvement if it lies
+# below 1 - threshold.
+
+NUM_BOOTSTRAP_SAMPLES = 2000
+DEFAULT_CONFIDENCE = 0.95
+DEFAULT_THRESHOLD = 0.02
+
+
+def load_trials(filename):
+    # runtasks writes JSON lines or CSV whatever the file is called, so
+    # the format comes from the first non-blank character
+    with open(filename) as f:
+        text = f.read()
+    start = text.lstrip()[:1]
+    if start == "[":
+        rows = json.loads(text)
+    elif start == "{":
+        rows = [json.loads(line) for line in text.splitlines() if line.strip()]
+    else:
+        rows = list(csv.DictReader(text.splitlines()))
+
+    groups = {}
+    for row in rows:
+        key = (row["test"], row["impl"], int(row["num_threads"]))
+        groups.setdefault(key, []).append(float(row["time_ms"]))
+    return groups
+
+
+def bootstrap_ratio_ci(base, cand, confidence, rng):
+    ratios = []
+    for _ in range(NUM_BOOTSTRAP_SAMPLES):
+        b = statistics.median(rng.choices(base, k=len(base)))
+        c = statistics.median(rng.choices(cand, k=len(cand)))
+        ratios.append(c / b)
+    ratios.sort()
+    tail = (1.0 - confidence) / 2
+    lo = ratios[int(tail * (NUM_BOOTSTRAP_SAMPLES - 1))]
+    hi = ratios[int((1.0 - tail) * (NUM_BOOTSTRAP_SAMPLES - 1))]
+    return lo, hi
+
+
+def main(args):
+    base = load_trials(args.baseline)
+    cand = load_trials(args.candidate)
+    rng = random.Random(args.seed)
+
+    keys = sorted(set(base) & set(cand))
+    if not keys:
+        print("No (test, impl, num_threads) groups in common")
+        return 1
+
+    print("%-40s %-32s %3s %10s %10s %8s %19s" %
+          ("test", "impl", "thr", "base(ms)", "cand(ms)", "ratio",
+           "%d%% CI" % int(args.confidence * 100)))
+
+    regressions = 0
+    for key in keys:
+        b, c = base[key], cand[key]
+        ratio = statistics.median(c) / statistics.median(b)
+        lo, hi = bootstrap_ratio_ci(b, c, args.confidence, rng)
+        verdict = ""
+        if lo > 1.0 + args.threshold:
+            verdict = "REGRESSION"
+            regressions += 1
+        elif hi < 1.0 - args.threshold:
+            verdict = "improvement"
+        elif min(len(b), len(c)) < 5:
+            verdict = "(few trials)"
+        print("%-40s %-32s %3d %10.3f %10.3f %8.3f    [%6.3f, %6.3f] %s" %
+              (key[0], key[1], key[2], statistics.median(b),
+               statistics.median(c), ratio, lo, hi, verdict))
+
+    for name, only in (("baseline", set(base) - set(cand)),
+                       ("candidate", set(cand) - set(base))):
+        for key in sorted(only):
+            print("Only in %s: %s [%s] n=%d" % (name, key[0], key[1], key[2]))
+
+    print("%d significant regression(s) out of %d comparisons" %
+          (regressions, len(keys)))
+    return 1 if regressions > 0 else 0
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description="Compare two runtasks --output files")
+    parser.add_argument("baseline", help="trials of the baseline build")
+    parser.add_argument("candidate", help="trials of the candidate build")
+    parser.add_argument("-c", "--confidence", type=float,
+                        default=DEFAULT_CONFIDENCE,
+                        help="confidence level of the intervals (default %.2f)"
+                        % DEFAULT_CONFIDENCE)
+    parser.add_argument("-t", "--threshold", type=float,
+                        default=DEFAULT_THRESHOLD,
+                        help="relative change below which a difference is "
+                        "ignored (default %.2f)" % DEFAULT_THRESHOLD)
+    parser.add_argument("-s", "--seed", type=int, default=0,
+                        help="random seed of the bootstrap")
+    sys.exit(main(parser.parse_args()))
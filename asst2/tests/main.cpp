@@ -3,9 +3,13 @@
 #include <getopt.h>
 #include <string>
 #include <assert.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 #include "tasksys.h"
 #include "tests.h"
+#include "trace.h"
 
 #define DEFAULT_NUM_THREADS 8
 #define DEFAULT_NUM_TIMING_ITERATIONS 3
@@ -16,6 +20,11 @@ void usage(const char* progname, std::string *testnames, int num_tests) {
     printf("Program Options:\n");
     printf("  -n  --num_threads  <INT>      Number of threads: <INT> (default=%d)\n", DEFAULT_NUM_THREADS);
     printf("  -i  --num_timing_iterations <INT> Number of timing iterations: <INT> (default=%d)\n", DEFAULT_NUM_TIMING_ITERATIONS);
+    printf("  -r  --record_trace <FILE>     Record the test's task graph and task costs to FILE\n");
+    printf("  -o  --output <FILE>           Append the time of every trial to FILE\n");
+    printf("  -f  --format <csv|json>       Format of the --output records (default=csv)\n");
+    printf("  -s  --sweep <MAX>             Sweep 1..MAX threads (powers of two and the core count) and\n"
+           "                                report speedup, efficiency and Karp-Flatt serial fraction\n");
     printf("  -?  --help                    This message\n");
     printf("Valid testnames are:");
     for(int i = 0; i < num_tests; i++) {
@@ -23,6 +32,26 @@ void usage(const char* progname, std::string *testnames, int num_tests) {
     }
 }
 
+/*
+ * Appends one trial to the --output file, either as a CSV row or as a
+ * JSON object on its own line. A CSV header is written when the file
+ * is empty, so results of several runs can accumulate in one file.
+ */
+void writeTrial(FILE* fp, bool json, const std::string& test_name,
+                const char* impl, int num_threads, int trial, double time) {
+    if (json) {
+        fprintf(fp, "{\"test\": \"%s\", \"impl\": \"%s\", \"num_threads\": %d, "
+                "\"trial\": %d, \"time_ms\": %.6f}\n",
+                test_name.c_str(), impl, num_threads, trial, time * 1000);
+    } else {
+        if (ftell(fp) == 0) {
+            fprintf(fp, "test,impl,num_threads,trial,time_ms\n");
+        }
+        fprintf(fp, "%s,%s,%d,%d,%.6f\n",
+                test_name.c_str(), impl, num_threads, trial, time * 1000);
+    }
+}
+
 enum TaskSystemType {
     SERIAL,
     PARALLEL_SPAWN,
@@ -47,11 +76,110 @@ ITaskSystem *selectTaskSystemRefImpl(int num_threads, TaskSystemType type) {
     }
 }
 
+/*
+ * Runs a test num_timing_iterations times, each on a freshly created
+ * task system, and returns the fastest time. Exits if a run fails its
+ * correctness check.
+ */
+double timeTest(TestResults (*test)(ITaskSystem*), const std::string& test_name,
+                TaskSystemType type, int num_threads, int num_timing_iterations,
+                FILE* output_fp, bool output_json, const char** impl_name) {
+    double minT = 1e30;
+    for (int j = 0; j < num_timing_iterations; j++) {
+
+        // Create a new task system
+        ITaskSystem *t = selectTaskSystemRefImpl(num_threads, type);
+        *impl_name = t->name();
+
+        // Run test
+        TestResults result = test(t);
+
+        // Check that the test result was correct
+        if (!result.passed) {
+            printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
+                j, t->name());
+            exit(1);
+        }
+
+        minT = std::min(minT, result.time);
+        if (output_fp != NULL) {
+            writeTrial(output_fp, output_json, test_name, t->name(),
+                       num_threads, j, result.time);
+        }
+
+        // Shutdown task system so each timing run is from a clean start
+        delete t;
+    }
+    return minT;
+}
+
+/*
+ * Thread counts of a sweep: the powers of two up to max_threads, plus
+ * the number of cores if it is not a power of two. The core count is
+ * left out when the platform does not report it (returns 0).
+ */
+std::vector<int> sweepThreadCounts(int max_threads) {
+    std::vector<int> counts;
+    for (int p = 1; p <= max_threads; p *= 2) {
+        counts.push_back(p);
+    }
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores > 0 && cores <= max_threads &&
+        std::find(counts.begin(), counts.end(), cores) == counts.end()) {
+        counts.insert(std::upper_bound(counts.begin(), counts.end(), cores), cores);
+    }
+    return counts;
+}
+
+/*
+ * Runs every implementation at each thread count of the sweep and
+ * prints, relative to the same implementation on one thread, the
+ * speedup S = T(1)/T(p), the efficiency S/p and the Karp-Flatt
+ * experimentally determined serial fraction e = (1/S - 1/p)/(1 - 1/p).
+ * A serial fraction that grows with p points at overhead (locking,
+ * scheduling, load imbalance) rather than at inherently serial work.
+ */
+void sweepTest(TestResults (*test)(ITaskSystem*), const std::string& test_name,
+               int max_threads, int num_timing_iterations,
+               FILE* output_fp, bool output_json) {
+    std::vector<int> counts = sweepThreadCounts(max_threads);
+
+    for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+        const char* impl_name = NULL;
+        double t1 = 0;
+        for (size_t c = 0; c < counts.size(); c++) {
+            int p = counts[c];
+            double tp = timeTest(test, test_name, (TaskSystemType) i, p,
+                                 num_timing_iterations, output_fp, output_json,
+                                 &impl_name);
+            if (c == 0) {
+                t1 = tp;
+                printf("[%s]:\n", impl_name);
+                printf("  %7s %12s %9s %11s %11s\n",
+                       "threads", "time (ms)", "speedup", "efficiency", "karp-flatt");
+            }
+            double speedup = t1 / tp;
+            if (p == 1) {
+                printf("  %7d %12.3f %9.2f %11.3f %11s\n",
+                       p, tp * 1000, speedup, speedup, "-");
+            } else {
+                double serial_fraction = (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p);
+                printf("  %7d %12.3f %9.2f %11.3f %11.3f\n",
+                       p, tp * 1000, speedup, speedup / p, serial_fraction);
+            }
+        }
+    }
+}
+
 int main(int argc, char** argv)
 {
-    const int n_tests = 31;
+    const int n_tests = 39;
     int num_threads = DEFAULT_NUM_THREADS;
     int num_timing_iterations = DEFAULT_NUM_TIMING_ITERATIONS;
+    const char* trace_file = NULL;
+    const char* output_file = NULL;
+    bool output_json = false;
+    int sweep_max_threads = 0;
 
     TestResults (*test[n_tests])(ITaskSystem*) = {
         simpleTestSync,
@@ -67,6 +195,9 @@ int main(int argc, char** argv)
         mathOperationsInTightForLoopReductionTreeTest,
         spinBetweenRunCallsTest,
         mandelbrotChunkedTest,
+        choleskyTiledTest,
+        smithWatermanWavefrontTest,
+        imagePipelineTest,
         pingPongEqualAsyncTest,
         pingPongUnequalAsyncTest,
         superLightAsyncTest,
@@ -83,6 +214,13 @@ int main(int argc, char** argv)
         strictGraphDepsSmall,
         strictGraphDepsMedium,
         strictGraphDepsLarge,
+        choleskyTiledAsyncTest,
+        smithWatermanWavefrontAsyncTest,
+        imagePipelineAsyncTest,
+        zeroTaskLaunchTest,
+        inFlightLimitTest,
+        inFlightLimitNonBlockingTest,
+        inFlightLimitRaiseTest,
     };
 
     std::string test_names[n_tests] = {
@@ -99,6 +237,9 @@ int main(int argc, char** argv)
         "math_operations_in_tight_for_loop_reduction_tree",
         "spin_between_run_calls",
         "mandelbrot_chunked",
+        "cholesky_tiled",
+        "smith_waterman_wavefront",
+        "image_pipeline",
         "ping_pong_equal_async",
         "ping_pong_unequal_async",
         "super_light_async",
@@ -115,6 +256,13 @@ int main(int argc, char** argv)
         "strict_graph_deps_small_async",
         "strict_graph_deps_med_async",
         "strict_graph_deps_large_async",
+        "cholesky_tiled_async",
+        "smith_waterman_wavefront_async",
+        "image_pipeline_async",
+        "zero_task_launches",
+        "in_flight_limit",
+        "in_flight_limit_non_blocking",
+        "in_flight_limit_raise",
     };
  
     // Parse commandline options
@@ -122,10 +270,14 @@ int main(int argc, char** argv)
     static struct option long_options[] = {
         {"num_threads",           1, 0,  'n'},
         {"num_timing_iterations", 1, 0,  'i'},
+        {"record_trace",          1, 0,  'r'},
+        {"output",                1, 0,  'o'},
+        {"format",                1, 0,  'f'},
+        {"sweep",                 1, 0,  's'},
         {"help",                  0, 0,  '?'},
     };
 
-    while ((opt = getopt_long(argc, argv, "n:i:?", long_options, NULL)) != EOF) {
+    while ((opt = getopt_long(argc, argv, "n:i:r:o:f:s:?", long_options, NULL)) != EOF) {
 
         switch (opt) {
         case 'n':
@@ -134,6 +286,23 @@ int main(int argc, char** argv)
         case 'i':
             num_timing_iterations = atoi(optarg);
             break;
+        case 'r':
+            trace_file = optarg;
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        case 'f':
+            if (std::string(optarg) == "json") {
+                output_json = true;
+            } else if (std::string(optarg) != "csv") {
+                fprintf(stderr, "Error: unknown output format %s!\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            sweep_max_threads = atoi(optarg);
+            break;
         case '?':
         default:
             usage(argv[0], test_names, n_tests);
@@ -149,6 +318,15 @@ int main(int argc, char** argv)
 
     std::string test_name = argv[optind];
 
+    FILE* output_fp = NULL;
+    if (output_file != NULL) {
+        output_fp = fopen(output_file, "a");
+        if (output_fp == NULL) {
+            fprintf(stderr, "Error: could not open output file %s\n", output_file);
+            return 1;
+        }
+    }
+
     bool found = false;
     for (int test_id = 0; test_id < n_tests; test_id++) {
         if (test_names[test_id].compare(test_name) != 0) {
@@ -162,37 +340,38 @@ int main(int argc, char** argv)
         printf("============================================================="
                "======================\n");
 
-        for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
-            double minT = 1e30;
-            for (int j = 0; j < num_timing_iterations; j++) {
-
-                // Create a new task system
-                ITaskSystem *t = selectTaskSystemRefImpl(num_threads, (TaskSystemType) i);
-
-                // Run test
-                TestResults result = test[test_id](t);
-
-                // Check that the test result was correct
-                if (!result.passed) {
-                    printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
-                        j, t->name());
-                    exit(1);
-                }
-
-                minT = std::min(minT, result.time);
-
-                // TODO: do this better
-                if( j+1 == num_timing_iterations) {
-                    printf("[%s]:\t\t[%.3f] ms\n", t->name(), minT * 1000);
-                }
+        if (sweep_max_threads > 0) {
+            sweepTest(test[test_id], test_name, sweep_max_threads,
+                      num_timing_iterations, output_fp, output_json);
+        } else {
+            for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+                const char* impl_name = NULL;
+                double minT = timeTest(test[test_id], test_name, (TaskSystemType) i,
+                                       num_threads, num_timing_iterations,
+                                       output_fp, output_json, &impl_name);
+                printf("[%s]:\t\t[%.3f] ms\n", impl_name, minT * 1000);
+            }
+        }
 
-                // Shutdown task system so each timing run is from a clean start
-                delete t;
+        if (trace_file != NULL) {
+            // Record under the serial implementation so that task costs
+            // are measured without contention from other tasks.
+            ITaskSystem *inner = selectTaskSystemRefImpl(num_threads, SERIAL);
+            TracingTaskSystem tracer(inner);
+            test[test_id](&tracer);
+            if (tracer.writeTrace(trace_file)) {
+                printf("Wrote task trace %s\n", trace_file);
+            } else {
+                fprintf(stderr, "Error: could not write trace file %s\n", trace_file);
             }
+            delete inner;
         }
         printf("============================================================="
                "======================\n");
     }
+    if (output_fp != NULL) {
+        fclose(output_fp);
+    }
     if (!found) {
         fprintf(stderr, "Error: invalid test_name!\n");
         usage(argv[0], test_names, n_tests);
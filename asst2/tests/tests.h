@@ -6,6 +6,7 @@
 #include <thread>
 #include <atomic>
 #include <set>
+#include <vector>
 
 #include "CycleTimer.h"
 #include "itasksys.h"
@@ -23,6 +24,9 @@ TestResults mathOperationsInTightForLoopFanInTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopReductionTreeTest(ITaskSystem* t);
 TestResults spinBetweenRunCallsTest(ITaskSystem *t);
 TestResults mandelbrotChunkedTest(ITaskSystem* t);
+TestResults choleskyTiledTest(ITaskSystem* t);
+TestResults smithWatermanWavefrontTest(ITaskSystem* t);
+TestResults imagePipelineTest(ITaskSystem* t);
 
 Async with dependencies tests
 =============================
@@ -37,6 +41,13 @@ TestResults mathOperationsInTightForLoopReductionTreeAsyncTest(ITaskSystem* t);
 TestResults spinBetweenRunCallsAsyncTest(ITaskSystem *t);
 TestResults mandelbrotChunkedAsyncTest(ITaskSystem* t);
 TestResults simpleRunDepsTest(ITaskSystem *t);
+TestResults choleskyTiledAsyncTest(ITaskSystem* t);
+TestResults smithWatermanWavefrontAsyncTest(ITaskSystem* t);
+TestResults imagePipelineAsyncTest(ITaskSystem* t);
+TestResults zeroTaskLaunchTest(ITaskSystem* t);
+TestResults inFlightLimitTest(ITaskSystem* t);
+TestResults inFlightLimitNonBlockingTest(ITaskSystem* t);
+TestResults inFlightLimitRaiseTest(ITaskSystem* t);
 */
 
 /*
@@ -241,6 +252,25 @@ class LightTask: public IRunnable {
         }
 };
 
+/*
+ * Each task waits until the gate is opened, and then copies its task id
+ * into the output. Keeps a launch in flight for as long as a test needs.
+ */
+class GateTask: public IRunnable {
+    public:
+        int *output_;
+        std::atomic<bool> open_;
+        GateTask(int *output) : output_(output), open_(false) {}
+        ~GateTask() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            while (!open_.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            output_[task_id] = task_id;
+        }
+};
+
 /*
  * Each task performs a sequence of exp, log, and multiplication
  * operations in a tight for loop.
@@ -488,6 +518,279 @@ class StrictDependencyTask: public IRunnable {
         ~StrictDependencyTask() {}
 };
 
+/*
+ * One tile operation of a tiled Cholesky factorization of the
+ * row-major n x n matrix `a_`, split into `tile_` x `tile_` tiles.
+ * POTRF factors diagonal tile (k,k); TRSM solves tile (i,k) against
+ * it; SYRK and GEMM subtract the contribution of column k from tiles
+ * (i,i) and (i,j). All operations except POTRF split the rows of their
+ * output tile among the tasks of the launch.
+ */
+class CholeskyTileTask : public IRunnable {
+    public:
+        enum Op { POTRF, TRSM, SYRK, GEMM };
+
+        double* a_;
+        int n_;
+        int tile_;
+        Op op_;
+        int i_, j_, k_;
+
+        CholeskyTileTask(double* a, int n, int tile, Op op, int i, int j, int k)
+            : a_(a), n_(n), tile_(tile), op_(op), i_(i), j_(j), k_(k) {}
+        ~CholeskyTileTask() {}
+
+        // Dot product of rows r and c of a_ over columns [start, end)
+        inline double rowDot(int r, int c, int start, int end) {
+            double sum = 0.0;
+            for (int p = start; p < end; p++)
+                sum += a_[r * n_ + p] * a_[c * n_ + p];
+            return sum;
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            int kb = k_ * tile_;
+
+            if (op_ == POTRF) {
+                for (int c = kb; c < kb + tile_; c++) {
+                    double diag = std::sqrt(a_[c * n_ + c] - rowDot(c, c, kb, c));
+                    a_[c * n_ + c] = diag;
+                    for (int r = c + 1; r < kb + tile_; r++)
+                        a_[r * n_ + c] = (a_[r * n_ + c] - rowDot(r, c, kb, c)) / diag;
+                }
+                return;
+            }
+
+            int rows_per_task = (tile_ + num_total_tasks - 1) / num_total_tasks;
+            int start_row = i_ * tile_ + task_id * rows_per_task;
+            int end_row = std::min(start_row + rows_per_task, (i_ + 1) * tile_);
+
+            for (int r = start_row; r < end_row; r++) {
+                if (op_ == TRSM) {
+                    for (int c = kb; c < kb + tile_; c++)
+                        a_[r * n_ + c] = (a_[r * n_ + c] - rowDot(r, c, kb, c)) / a_[c * n_ + c];
+                } else {
+                    int jb = j_ * tile_;
+                    int end_col = (op_ == SYRK) ? r + 1 : jb + tile_;
+                    for (int c = jb; c < end_col; c++)
+                        a_[r * n_ + c] -= rowDot(r, c, kb, kb + tile_);
+                }
+            }
+        }
+};
+
+/*
+ * Each task fills one `block_` x `block_` block of the Smith-Waterman
+ * local alignment score matrix `h_` of sequences `a_` and `b_` (linear
+ * gap penalty). `h_` is (len_a + 1) x (len_b + 1), row-major, with a
+ * zero first row and column. Block (bi, bj) reads the last row of the
+ * block above and the last column of the block to its left.
+ */
+class SmithWatermanBlockTask : public IRunnable {
+    public:
+        const char* a_;
+        const char* b_;
+        int* h_;
+        int len_b_;
+        int block_;
+        int bi_, bj_;
+
+        static const int kMatch = 2;
+        static const int kMismatch = -1;
+        static const int kGap = 1;
+
+        SmithWatermanBlockTask(const char* a, const char* b, int* h, int len_b,
+                               int block, int bi, int bj)
+            : a_(a), b_(b), h_(h), len_b_(len_b), block_(block), bi_(bi), bj_(bj) {}
+        ~SmithWatermanBlockTask() {}
+
+        static inline int cell(const char* a, const char* b, int* h, int stride,
+                               int i, int j) {
+            int diag = h[(i-1) * stride + (j-1)] + (a[i-1] == b[j-1] ? kMatch : kMismatch);
+            int up = h[(i-1) * stride + j] - kGap;
+            int left = h[i * stride + (j-1)] - kGap;
+            return std::max(std::max(0, diag), std::max(up, left));
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            int stride = len_b_ + 1;
+            for (int i = bi_ * block_ + 1; i <= (bi_ + 1) * block_; i++) {
+                for (int j = bj_ * block_ + 1; j <= (bj_ + 1) * block_; j++)
+                    h_[i * stride + j] = cell(a_, b_, h_, stride, i, j);
+            }
+        }
+};
+
+/*
+ * Stages of a banded image pipeline over a Mandelbrot image. Each
+ * launch of a stage processes one horizontal band of `band_rows_`
+ * rows, split among its tasks. Stencil stages read one row above and
+ * below their band, clamped at the image edges.
+ */
+class ImageBandTask : public IRunnable {
+    public:
+        int width_;
+        int height_;
+        int band_;
+        int band_rows_;
+
+        ImageBandTask(int width, int height, int band, int band_rows)
+            : width_(width), height_(height), band_(band), band_rows_(band_rows) {}
+        virtual ~ImageBandTask() {}
+
+        virtual void processRow(int row) {}
+
+        // Rows [*start_row, *end_row) of the band belong to task_id
+        void taskRows(int task_id, int num_total_tasks, int* start_row, int* end_row) {
+            int rows_per_task = (band_rows_ + num_total_tasks - 1) / num_total_tasks;
+            *start_row = band_ * band_rows_ + task_id * rows_per_task;
+            *end_row = std::min(std::min(*start_row + rows_per_task,
+                                         (band_ + 1) * band_rows_), height_);
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            int start_row, end_row;
+            taskRows(task_id, num_total_tasks, &start_row, &end_row);
+            for (int row = start_row; row < end_row; row++)
+                processRow(row);
+        }
+};
+
+/*
+ * Stage 1: renders the rows of the band with MandelbrotTask.
+ */
+class MandelbrotBandTask : public ImageBandTask {
+    public:
+        MandelbrotTask* mandel_;
+
+        MandelbrotBandTask(MandelbrotTask* mandel, int band, int band_rows)
+            : ImageBandTask(mandel->args_->width, mandel->args_->height, band, band_rows),
+              mandel_(mandel) {}
+
+        void processRow(int row) {
+            MandelbrotTask::MandelArgs* ma = mandel_->args_;
+            mandel_->mandelbrotSerial(ma->x0, ma->y0, ma->x1, ma->y1,
+                                      ma->width, ma->height, row, 1,
+                                      ma->max_iterations, ma->output);
+        }
+};
+
+/*
+ * Stage 2: 3x3 box blur of the iteration counts.
+ */
+class BoxBlurBandTask : public ImageBandTask {
+    public:
+        const int* input_;
+        float* output_;
+
+        BoxBlurBandTask(const int* input, float* output, int width, int height,
+                        int band, int band_rows)
+            : ImageBandTask(width, height, band, band_rows),
+              input_(input), output_(output) {}
+
+        void processRow(int row) {
+            for (int x = 0; x < width_; x++) {
+                int sum = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    int yy = std::min(std::max(row + dy, 0), height_ - 1);
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int xx = std::min(std::max(x + dx, 0), width_ - 1);
+                        sum += input_[yy * width_ + xx];
+                    }
+                }
+                output_[row * width_ + x] = sum / 9.f;
+            }
+        }
+};
+
+/*
+ * Stage 3: Sobel gradient magnitude of the blurred image.
+ */
+class SobelBandTask : public ImageBandTask {
+    public:
+        const float* input_;
+        float* output_;
+
+        SobelBandTask(const float* input, float* output, int width, int height,
+                      int band, int band_rows)
+            : ImageBandTask(width, height, band, band_rows),
+              input_(input), output_(output) {}
+
+        inline float at(int x, int y) {
+            x = std::min(std::max(x, 0), width_ - 1);
+            y = std::min(std::max(y, 0), height_ - 1);
+            return input_[y * width_ + x];
+        }
+
+        void processRow(int row) {
+            for (int x = 0; x < width_; x++) {
+                float gx = (at(x+1, row-1) + 2.f * at(x+1, row) + at(x+1, row+1)) -
+                           (at(x-1, row-1) + 2.f * at(x-1, row) + at(x-1, row+1));
+                float gy = (at(x-1, row+1) + 2.f * at(x, row+1) + at(x+1, row+1)) -
+                           (at(x-1, row-1) + 2.f * at(x, row-1) + at(x+1, row-1));
+                output_[row * width_ + x] = std::sqrt(gx * gx + gy * gy);
+            }
+        }
+};
+
+/*
+ * Stage 4: histogram of the edge magnitudes of the band, one histogram
+ * per task so that tasks never share counters.
+ */
+class HistogramBandTask : public ImageBandTask {
+    public:
+        static const int kBins = 64;
+        static constexpr float kMaxMagnitude = 1024.f;
+
+        const float* input_;
+        int* bins_; // num_total_tasks * kBins counters for this band
+
+        HistogramBandTask(const float* input, int* bins, int width, int height,
+                          int band, int band_rows)
+            : ImageBandTask(width, height, band, band_rows),
+              input_(input), bins_(bins) {}
+
+        static inline int binOf(float v) {
+            int b = static_cast<int>(v / kMaxMagnitude * kBins);
+            return std::min(std::max(b, 0), kBins - 1);
+        }
+
+        void runTask(int task_id, int num_total_tasks) {
+            int* bins = bins_ + task_id * kBins;
+            for (int i = 0; i < kBins; i++)
+                bins[i] = 0;
+
+            int start_row, end_row;
+            taskRows(task_id, num_total_tasks, &start_row, &end_row);
+            for (int row = start_row; row < end_row; row++) {
+                for (int x = 0; x < width_; x++)
+                    bins[binOf(input_[row * width_ + x])]++;
+            }
+        }
+};
+
+/*
+ * Stage 5: sums the per-task histograms of all bands.
+ */
+class HistogramReduceTask : public IRunnable {
+    public:
+        const int* bins_;
+        int num_histograms_;
+        int* output_;
+
+        HistogramReduceTask(const int* bins, int num_histograms, int* output)
+            : bins_(bins), num_histograms_(num_histograms), output_(output) {}
+        ~HistogramReduceTask() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            for (int b = 0; b < HistogramBandTask::kBins; b++) {
+                output_[b] = 0;
+                for (int h = 0; h < num_histograms_; h++)
+                    output_[b] += bins_[h * HistogramBandTask::kBins + b];
+            }
+        }
+};
+
 /* 
  * ==================================================================
  *   Begin test definitions
@@ -1403,3 +1706,614 @@ TestResults strictGraphDepsMedium(ITaskSystem* t) {
 TestResults strictGraphDepsLarge(ITaskSystem* t) {
     return strictGraphDepsTestBase(t,1000,20000,0);
 }
+
+/*
+ * Computation: Tiled Cholesky factorization of a symmetric positive
+ * definite matrix. Every tile operation (POTRF, TRSM, SYRK, GEMM) is its
+ * own bulk task launch. The async version expresses the tile-level data
+ * dependencies, giving a DAG whose available parallelism grows and
+ * shrinks as the factorization proceeds. The result is checked against
+ * an unblocked serial factorization.
+ */
+TestResults choleskyTiledTestBase(ITaskSystem* t, bool do_async) {
+
+    int num_tiles = 16;
+    int tile = 64;
+    int num_tasks = 8;
+    int n = num_tiles * tile;
+
+    // Random symmetric, diagonally dominant (hence SPD) input
+    srand(149);
+    double* a = new double[n * n];
+    double* golden = new double[n * n];
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j <= i; j++) {
+            double v = (double)rand() / RAND_MAX;
+            a[i * n + j] = a[j * n + i] = v;
+        }
+        a[i * n + i] += n;
+    }
+    for (int i = 0; i < n * n; i++) {
+        golden[i] = a[i];
+    }
+
+    std::vector<CholeskyTileTask> ops;
+    for (int k = 0; k < num_tiles; k++) {
+        ops.push_back(CholeskyTileTask(a, n, tile, CholeskyTileTask::POTRF, k, k, k));
+        for (int i = k + 1; i < num_tiles; i++)
+            ops.push_back(CholeskyTileTask(a, n, tile, CholeskyTileTask::TRSM, i, k, k));
+        for (int i = k + 1; i < num_tiles; i++) {
+            ops.push_back(CholeskyTileTask(a, n, tile, CholeskyTileTask::SYRK, i, i, k));
+            for (int j = k + 1; j < i; j++)
+                ops.push_back(CholeskyTileTask(a, n, tile, CholeskyTileTask::GEMM, i, j, k));
+        }
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    if (do_async) {
+        // Last launch that wrote each tile
+        std::vector<TaskID> writer(num_tiles * num_tiles, -1);
+        for (CholeskyTileTask& op : ops) {
+            std::vector<TaskID> deps;
+            if (writer[op.i_ * num_tiles + op.j_] != -1)
+                deps.push_back(writer[op.i_ * num_tiles + op.j_]);
+            if (op.op_ == CholeskyTileTask::TRSM) {
+                deps.push_back(writer[op.k_ * num_tiles + op.k_]);
+            } else if (op.op_ != CholeskyTileTask::POTRF) {
+                deps.push_back(writer[op.i_ * num_tiles + op.k_]);
+                if (op.op_ == CholeskyTileTask::GEMM)
+                    deps.push_back(writer[op.j_ * num_tiles + op.k_]);
+            }
+            int tasks = (op.op_ == CholeskyTileTask::POTRF) ? 1 : num_tasks;
+            writer[op.i_ * num_tiles + op.j_] = t->runAsyncWithDeps(&op, tasks, deps);
+        }
+        t->sync();
+    } else {
+        for (CholeskyTileTask& op : ops) {
+            t->run(&op, (op.op_ == CholeskyTileTask::POTRF) ? 1 : num_tasks);
+        }
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    // Unblocked serial factorization, done as a single "tile"
+    CholeskyTileTask serial(golden, n, n, CholeskyTileTask::POTRF, 0, 0, 0);
+    serial.runTask(0, 1);
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < n && result.passed; i++) {
+        for (int j = 0; j <= i; j++) {
+            double expected = golden[i * n + j];
+            if (std::fabs(a[i * n + j] - expected) > 1e-9 * std::max(1.0, std::fabs(expected))) {
+                printf("L[%d][%d]: %f expected=%f\n", i, j, a[i * n + j], expected);
+                result.passed = false;
+                break;
+            }
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] a;
+    delete [] golden;
+
+    return result;
+}
+
+TestResults choleskyTiledTest(ITaskSystem* t) {
+    return choleskyTiledTestBase(t, false);
+}
+
+TestResults choleskyTiledAsyncTest(ITaskSystem* t) {
+    return choleskyTiledTestBase(t, true);
+}
+
+/*
+ * Computation: Smith-Waterman local alignment of two random DNA
+ * sequences, blocked into a grid of single-task launches. In the async
+ * version each block depends on the block above it and the block to its
+ * left, so the ready set sweeps across the grid as an anti-diagonal
+ * wavefront that first widens and then narrows. The score matrix is
+ * checked against a serial computation.
+ */
+TestResults smithWatermanWavefrontTestBase(ITaskSystem* t, bool do_async) {
+
+    int block = 64;
+    int num_blocks = 32;
+    int len = block * num_blocks;
+    int stride = len + 1;
+
+    srand(149);
+    const char bases[] = "ACGT";
+    char* seq_a = new char[len];
+    char* seq_b = new char[len];
+    for (int i = 0; i < len; i++) {
+        seq_a[i] = bases[rand() % 4];
+        seq_b[i] = bases[rand() % 4];
+    }
+
+    // Row and column 0 stay zero
+    int* h = new int[stride * stride]();
+    int* golden = new int[stride * stride]();
+
+    std::vector<SmithWatermanBlockTask> blocks;
+    for (int bi = 0; bi < num_blocks; bi++) {
+        for (int bj = 0; bj < num_blocks; bj++)
+            blocks.push_back(SmithWatermanBlockTask(seq_a, seq_b, h, len, block, bi, bj));
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    if (do_async) {
+        std::vector<TaskID> ids(num_blocks * num_blocks);
+        for (int bi = 0; bi < num_blocks; bi++) {
+            for (int bj = 0; bj < num_blocks; bj++) {
+                std::vector<TaskID> deps;
+                if (bi > 0)
+                    deps.push_back(ids[(bi - 1) * num_blocks + bj]);
+                if (bj > 0)
+                    deps.push_back(ids[bi * num_blocks + bj - 1]);
+                ids[bi * num_blocks + bj] =
+                    t->runAsyncWithDeps(&blocks[bi * num_blocks + bj], 1, deps);
+            }
+        }
+        t->sync();
+    } else {
+        for (SmithWatermanBlockTask& b : blocks) {
+            t->run(&b, 1);
+        }
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    for (int i = 1; i <= len; i++) {
+        for (int j = 1; j <= len; j++)
+            golden[i * stride + j] =
+                SmithWatermanBlockTask::cell(seq_a, seq_b, golden, stride, i, j);
+    }
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < stride * stride; i++) {
+        if (h[i] != golden[i]) {
+            printf("H[%d][%d]: %d expected=%d\n", i / stride, i % stride, h[i], golden[i]);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] seq_a;
+    delete [] seq_b;
+    delete [] h;
+    delete [] golden;
+
+    return result;
+}
+
+TestResults smithWatermanWavefrontTest(ITaskSystem* t) {
+    return smithWatermanWavefrontTestBase(t, false);
+}
+
+TestResults smithWatermanWavefrontAsyncTest(ITaskSystem* t) {
+    return smithWatermanWavefrontTestBase(t, true);
+}
+
+/*
+ * Computation: A five stage image pipeline over horizontal bands of a
+ * Mandelbrot image: render (MandelbrotTask), 3x3 box blur, Sobel edge
+ * magnitude, per-band histogram and a final histogram reduction. In the
+ * async version each stencil stage of band b depends on bands b-1, b
+ * and b+1 of the previous stage, so different bands can be in different
+ * stages at the same time. All stages are checked against a serial run
+ * of the same pipeline.
+ */
+TestResults imagePipelineTestBase(ITaskSystem* t, bool do_async) {
+
+    int num_bands = 16;
+    int num_tasks = 8;
+    int bins = HistogramBandTask::kBins;
+
+    MandelbrotTask::MandelArgs ma;
+    ma.x0 = -2;
+    ma.x1 = 1;
+    ma.y0 = -1;
+    ma.y1 = 1;
+    ma.width = 1600;
+    ma.height = 1200;
+    ma.max_iterations = 256;
+    int pixels = ma.width * ma.height;
+    int band_rows = (ma.height + num_bands - 1) / num_bands;
+
+    // Index 0 holds the task-based results, index 1 the serial ones
+    int* iters[2];
+    float* blurred[2];
+    float* edges[2];
+    int* band_bins[2];
+    int* histogram[2];
+    for (int v = 0; v < 2; v++) {
+        iters[v] = new int[pixels];
+        blurred[v] = new float[pixels];
+        edges[v] = new float[pixels];
+        band_bins[v] = new int[num_bands * num_tasks * bins];
+        histogram[v] = new int[bins];
+    }
+
+    MandelbrotTask::MandelArgs ma_serial = ma;
+    ma.output = iters[0];
+    ma_serial.output = iters[1];
+    MandelbrotTask mandel_task(&ma, false);
+    MandelbrotTask mandel_serial(&ma_serial, false);
+
+    std::vector<ImageBandTask*> stages[2][4];
+    for (int v = 0; v < 2; v++) {
+        for (int b = 0; b < num_bands; b++) {
+            stages[v][0].push_back(new MandelbrotBandTask(
+                v == 0 ? &mandel_task : &mandel_serial, b, band_rows));
+            stages[v][1].push_back(new BoxBlurBandTask(
+                iters[v], blurred[v], ma.width, ma.height, b, band_rows));
+            stages[v][2].push_back(new SobelBandTask(
+                blurred[v], edges[v], ma.width, ma.height, b, band_rows));
+            stages[v][3].push_back(new HistogramBandTask(
+                edges[v], band_bins[v] + b * num_tasks * bins,
+                ma.width, ma.height, b, band_rows));
+        }
+    }
+    HistogramReduceTask reduce_task(band_bins[0], num_bands * num_tasks, histogram[0]);
+    HistogramReduceTask reduce_serial(band_bins[1], num_bands * num_tasks, histogram[1]);
+
+    double start_time = CycleTimer::currentSeconds();
+    if (do_async) {
+        std::vector<TaskID> prev(num_bands);
+        std::vector<TaskID> cur(num_bands);
+        for (int s = 0; s < 4; s++) {
+            for (int b = 0; b < num_bands; b++) {
+                std::vector<TaskID> deps;
+                if (s > 0) {
+                    // Stencils read one row beyond the band; the histogram
+                    // only reads its own band.
+                    int reach = (s == 3) ? 0 : 1;
+                    for (int nb = std::max(b - reach, 0);
+                         nb <= std::min(b + reach, num_bands - 1); nb++)
+                        deps.push_back(prev[nb]);
+                }
+                cur[b] = t->runAsyncWithDeps(stages[0][s][b], num_tasks, deps);
+            }
+            prev.swap(cur);
+        }
+        t->runAsyncWithDeps(&reduce_task, 1, prev);
+        t->sync();
+    } else {
+        for (int s = 0; s < 4; s++) {
+            for (int b = 0; b < num_bands; b++) {
+                t->run(stages[0][s][b], num_tasks);
+            }
+        }
+        t->run(&reduce_task, 1);
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    for (int s = 0; s < 4; s++) {
+        for (int b = 0; b < num_bands; b++) {
+            for (int i = 0; i < num_tasks; i++)
+                stages[1][s][b]->runTask(i, num_tasks);
+        }
+    }
+    reduce_serial.runTask(0, 1);
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < pixels && result.passed; i++) {
+        if (iters[0][i] != iters[1][i] || blurred[0][i] != blurred[1][i] ||
+            edges[0][i] != edges[1][i]) {
+            printf("pixel %d: stage outputs differ from serial\n", i);
+            result.passed = false;
+        }
+    }
+    for (int i = 0; i < bins && result.passed; i++) {
+        if (histogram[0][i] != histogram[1][i]) {
+            printf("bin %d: %d expected=%d\n", i, histogram[0][i], histogram[1][i]);
+            result.passed = false;
+        }
+    }
+    result.time = end_time - start_time;
+
+    for (int v = 0; v < 2; v++) {
+        for (int s = 0; s < 4; s++) {
+            for (ImageBandTask* task : stages[v][s])
+                delete task;
+        }
+        delete [] iters[v];
+        delete [] blurred[v];
+        delete [] edges[v];
+        delete [] band_bins[v];
+        delete [] histogram[v];
+    }
+
+    return result;
+}
+
+TestResults imagePipelineTest(ITaskSystem* t) {
+    return imagePipelineTestBase(t, false);
+}
+
+TestResults imagePipelineAsyncTest(ITaskSystem* t) {
+    return imagePipelineTestBase(t, true);
+}
+
+/*
+ * Bulk launches of zero tasks: a synchronous one, and asynchronous ones
+ * that are ready right away or wait on a dependency, with and without
+ * dependents. The task system has to treat them as finished at once,
+ * or neither sync() nor the launches that depend on them ever complete.
+ */
+TestResults zeroTaskLaunchTest(ITaskSystem* t) {
+    const int num_tasks = 16;
+    int* b_output = new int[num_tasks];
+    int* d_output = new int[num_tasks];
+    for (int i = 0; i < num_tasks; i++) {
+        b_output[i] = -1;
+        d_output[i] = -1;
+    }
+
+    IRunnable* empty = new LightTask(NULL);
+    IRunnable* b = new LightTask(b_output);
+    IRunnable* d = new LightTask(d_output);
+
+    double start_time = CycleTimer::currentSeconds();
+    t->run(empty, 0);
+
+    // ready at launch, with a dependent
+    TaskID a_task_id = t->runAsyncWithDeps(empty, 0, std::vector<TaskID>());
+    TaskID b_task_id = t->runAsyncWithDeps(b, num_tasks, {a_task_id});
+
+    // released when b finishes, with a dependent
+    TaskID c_task_id = t->runAsyncWithDeps(empty, 0, {b_task_id});
+    t->runAsyncWithDeps(d, num_tasks, {c_task_id});
+
+    // ready at launch, without dependents
+    t->runAsyncWithDeps(empty, 0, std::vector<TaskID>());
+
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < num_tasks; i++) {
+        if (b_output[i] != i || d_output[i] != i) {
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete[] b_output;
+    delete[] d_output;
+    delete empty;
+    delete b;
+    delete d;
+
+    return result;
+}
+
+/*
+ * The in-flight limit tests drive setInFlightLimit() and occupancy(),
+ * which only the thread pool sleeping task system of part_b provides.
+ * Every other task system passes them without running anything.
+ */
+#ifdef TASKSYS_IN_FLIGHT_LIMIT
+static TaskSystemParallelThreadPoolSleeping* inFlightLimitSystem(ITaskSystem* t) {
+    return dynamic_cast<TaskSystemParallelThreadPoolSleeping*>(t);
+}
+#endif
+
+/*
+ * A producer launches a chain of small bulk launches under a small
+ * blocking limit. After every launch, the occupancy has to stay within
+ * the limit, and in the end every task has to have run.
+ */
+TestResults inFlightLimitTest(ITaskSystem* t) {
+    TestResults result;
+    result.passed = true;
+    result.time = 0;
+#ifdef TASKSYS_IN_FLIGHT_LIMIT
+    TaskSystemParallelThreadPoolSleeping* s = inFlightLimitSystem(t);
+    if (s == NULL) {
+        return result;
+    }
+
+    const int max_tasks = 8;
+    const int max_launches = 3;
+    const int num_launches = 64;
+    const int num_tasks = 4;
+    int* output = new int[num_launches * num_tasks];
+    for (int i = 0; i < num_launches * num_tasks; i++) {
+        output[i] = -1;
+    }
+    std::vector<LightTask*> runnables;
+    for (int i = 0; i < num_launches; i++) {
+        runnables.push_back(new LightTask(output + i * num_tasks));
+    }
+
+    InFlightLimit limit;
+    limit.maxTasks_ = max_tasks;
+    limit.maxLaunches_ = max_launches;
+    s->setInFlightLimit(limit);
+
+    double start_time = CycleTimer::currentSeconds();
+    std::vector<TaskID> deps;
+    for (int i = 0; i < num_launches; i++) {
+        TaskID id = s->runAsyncWithDeps(runnables[i], num_tasks, deps);
+        QueueOccupancy o = s->occupancy();
+        if (id < 0 || o.inFlightTasks_ > max_tasks ||
+            o.inFlightLaunches_ > max_launches ||
+            o.readyTasks_ > o.inFlightTasks_ ||
+            o.pendingLaunches_ > o.inFlightLaunches_) {
+            result.passed = false;
+        }
+        // every other launch waits on the one before it
+        deps.clear();
+        if (i % 2 == 0) {
+            deps.push_back(id);
+        }
+    }
+    s->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    QueueOccupancy o = s->occupancy();
+    if (o.readyTasks_ != 0 || o.pendingLaunches_ != 0 ||
+        o.inFlightTasks_ != 0 || o.inFlightLaunches_ != 0) {
+        result.passed = false;
+    }
+    for (int i = 0; i < num_launches * num_tasks; i++) {
+        if (output[i] != i % num_tasks) {
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    s->setInFlightLimit(InFlightLimit());
+    for (LightTask* r : runnables) {
+        delete r;
+    }
+    delete[] output;
+#endif
+    return result;
+}
+
+/*
+ * Under a non-blocking limit of one launch, a launch made while a gated
+ * launch is in flight has to return kWouldBlock without launching
+ * anything. Once the gate opens and sync() drains the task system, the
+ * same launch has to be accepted.
+ */
+TestResults inFlightLimitNonBlockingTest(ITaskSystem* t) {
+    TestResults result;
+    result.passed = true;
+    result.time = 0;
+#ifdef TASKSYS_IN_FLIGHT_LIMIT
+    TaskSystemParallelThreadPoolSleeping* s = inFlightLimitSystem(t);
+    if (s == NULL) {
+        return result;
+    }
+
+    const int num_tasks = 4;
+    int* a_output = new int[num_tasks];
+    int* b_output = new int[num_tasks];
+    for (int i = 0; i < num_tasks; i++) {
+        a_output[i] = -1;
+        b_output[i] = -1;
+    }
+    GateTask* a = new GateTask(a_output);
+    LightTask* b = new LightTask(b_output);
+
+    InFlightLimit limit;
+    limit.maxLaunches_ = 1;
+    limit.block_ = false;
+    s->setInFlightLimit(limit);
+
+    double start_time = CycleTimer::currentSeconds();
+    TaskID a_task_id = s->runAsyncWithDeps(a, num_tasks, std::vector<TaskID>());
+    TaskID b_task_id = s->runAsyncWithDeps(b, num_tasks, std::vector<TaskID>());
+    QueueOccupancy o = s->occupancy();
+    if (a_task_id < 0 || b_task_id != kWouldBlock ||
+        o.inFlightLaunches_ != 1 || o.inFlightTasks_ > num_tasks) {
+        result.passed = false;
+    }
+
+    a->open_ = true;
+    s->sync();
+    b_task_id = s->runAsyncWithDeps(b, num_tasks, {a_task_id});
+    if (b_task_id < 0) {
+        result.passed = false;
+    }
+    s->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    for (int i = 0; i < num_tasks; i++) {
+        if (a_output[i] != i || b_output[i] != i) {
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    s->setInFlightLimit(InFlightLimit());
+    delete a;
+    delete b;
+    delete[] a_output;
+    delete[] b_output;
+#endif
+    return result;
+}
+
+/*
+ * A producer thread blocks under a limit of one launch while a gated
+ * launch is in flight. Raising the limit has to wake it up and let its
+ * launch through before the gate opens.
+ */
+TestResults inFlightLimitRaiseTest(ITaskSystem* t) {
+    TestResults result;
+    result.passed = true;
+    result.time = 0;
+#ifdef TASKSYS_IN_FLIGHT_LIMIT
+    TaskSystemParallelThreadPoolSleeping* s = inFlightLimitSystem(t);
+    if (s == NULL) {
+        return result;
+    }
+
+    const int num_tasks = 4;
+    int* a_output = new int[num_tasks];
+    int* b_output = new int[num_tasks];
+    for (int i = 0; i < num_tasks; i++) {
+        a_output[i] = -1;
+        b_output[i] = -1;
+    }
+    GateTask* a = new GateTask(a_output);
+    LightTask* b = new LightTask(b_output);
+
+    InFlightLimit limit;
+    limit.maxLaunches_ = 1;
+    s->setInFlightLimit(limit);
+
+    double start_time = CycleTimer::currentSeconds();
+    s->runAsyncWithDeps(a, num_tasks, std::vector<TaskID>());
+
+    std::atomic<bool> launched(false);
+    std::thread producer([&] {
+        s->runAsyncWithDeps(b, num_tasks, std::vector<TaskID>());
+        launched = true;
+    });
+
+    // the producer has to stay blocked while the limit holds
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (launched.load()) {
+        result.passed = false;
+    }
+
+    s->setInFlightLimit(InFlightLimit());
+    while (!launched.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    producer.join();
+    if (s->occupancy().inFlightLaunches_ != 2) {
+        result.passed = false;
+    }
+
+    a->open_ = true;
+    s->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    for (int i = 0; i < num_tasks; i++) {
+        if (a_output[i] != i || b_output[i] != i) {
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete a;
+    delete b;
+    delete[] a_output;
+    delete[] b_output;
+#endif
+    return result;
+}
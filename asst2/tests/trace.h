@@ -0,0 +1,139 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "CycleTimer.h"
+#include "itasksys.h"
+
+/*
+ * ==================================================================
+ *  Task graph tracing. TracingTaskSystem forwards every call to an
+ *  inner task system and records the launches, their dependencies,
+ *  sync points and the running time of every task. writeTrace()
+ *  dumps the recording in the text format read by
+ *  ../tools/sched_sim:
+ *
+ *    launch <id> <num_tasks> <num_deps> <dep ids...>
+ *    sync
+ *    task <launch id> <task id> <cost in microseconds>
+ *
+ *  A run() call is recorded as a launch followed by a sync. Trace ids
+ *  are assigned in launch order, starting from 0.
+ * ==================================================================
+ */
+
+/*
+ * Times each task of a launch before handing it to the traced runnable.
+ * Each task writes only its own slot, so no locking is needed.
+ */
+class TimedRunnable : public IRunnable {
+    public:
+        IRunnable* inner_;
+        std::vector<double> costs_;
+
+        TimedRunnable(IRunnable* inner, int num_total_tasks)
+            : inner_(inner), costs_(num_total_tasks, 0.0) {}
+        ~TimedRunnable() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            double start_time = CycleTimer::currentSeconds();
+            inner_->runTask(task_id, num_total_tasks);
+            costs_[task_id] = CycleTimer::currentSeconds() - start_time;
+        }
+};
+
+class TracingTaskSystem : public ITaskSystem {
+    private:
+        struct Event {
+            bool is_sync;
+            int num_tasks;
+            std::vector<TaskID> deps;
+        };
+
+        ITaskSystem* inner_;
+        std::vector<Event> events_;
+        std::vector<TimedRunnable*> runnables_;
+        std::vector<TaskID> inner_ids_;
+
+        TaskID record(IRunnable* runnable, int num_total_tasks,
+                      const std::vector<TaskID>& deps, TimedRunnable** timed) {
+            *timed = new TimedRunnable(runnable, num_total_tasks);
+            runnables_.push_back(*timed);
+            events_.push_back({false, num_total_tasks, deps});
+            inner_ids_.push_back(-1);
+            return (TaskID)runnables_.size() - 1;
+        }
+
+    public:
+        TracingTaskSystem(ITaskSystem* inner)
+            : ITaskSystem(0), inner_(inner) {}
+        ~TracingTaskSystem() {
+            for (TimedRunnable* r : runnables_)
+                delete r;
+        }
+
+        const char* name() { return inner_->name(); }
+
+        void run(IRunnable* runnable, int num_total_tasks) {
+            TimedRunnable* timed;
+            record(runnable, num_total_tasks, std::vector<TaskID>(), &timed);
+            inner_->run(timed, num_total_tasks);
+            events_.push_back({true, 0, std::vector<TaskID>()});
+        }
+
+        TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
+                                const std::vector<TaskID>& deps) {
+            TimedRunnable* timed;
+            TaskID id = record(runnable, num_total_tasks, deps, &timed);
+            // Launches made through run() have already completed and have
+            // no inner id, so they are dropped from the inner dependencies.
+            std::vector<TaskID> inner_deps;
+            for (TaskID dep : deps) {
+                if (inner_ids_[dep] != -1)
+                    inner_deps.push_back(inner_ids_[dep]);
+            }
+            inner_ids_[id] = inner_->runAsyncWithDeps(timed, num_total_tasks,
+                                                      inner_deps);
+            return id;
+        }
+
+        void sync() {
+            inner_->sync();
+            events_.push_back({true, 0, std::vector<TaskID>()});
+        }
+
+        /*
+         * Writes the recorded trace. Only valid once every launch has
+         * completed, i.e. after the final sync().
+         */
+        bool writeTrace(const char* filename) {
+            FILE* fp = fopen(filename, "w");
+            if (fp == NULL)
+                return false;
+
+            fprintf(fp, "# %s\n", inner_->name());
+            TaskID id = 0;
+            for (const Event& e : events_) {
+                if (e.is_sync) {
+                    fprintf(fp, "sync\n");
+                    continue;
+                }
+                fprintf(fp, "launch %d %d %d", id, e.num_tasks, (int)e.deps.size());
+                for (TaskID dep : e.deps)
+                    fprintf(fp, " %d", dep);
+                fprintf(fp, "\n");
+                id++;
+            }
+            for (size_t i = 0; i < runnables_.size(); i++) {
+                const std::vector<double>& costs = runnables_[i]->costs_;
+                for (size_t j = 0; j < costs.size(); j++)
+                    fprintf(fp, "task %d %d %.3f\n", (int)i, (int)j, costs[j] * 1e6);
+            }
+            fclose(fp);
+            return true;
+        }
+};
+
+#endif
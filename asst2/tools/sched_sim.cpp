@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <deque>
+#include <getopt.h>
+#include <queue>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//
+// sched_sim --
+//
+// Discrete-event simulator that replays a task graph recorded with
+// `runtasks -r <FILE>` (see ../tests/trace.h) against models of
+// different task system scheduling policies, and predicts the makespan
+// and utilization each would reach at a given thread count.
+//
+// The model assumes that the producer issues every launch at time 0,
+// that a launch becomes runnable once its dependencies and all launches
+// before the preceding sync are done, and that a task always takes the
+// time recorded for it plus a fixed dispatch overhead.
+
+#define DEFAULT_THREAD_COUNTS "1,2,4,8,16,32,64"
+#define DEFAULT_POLICIES "fifo,ws,prio"
+
+struct Launch {
+  std::vector<double> costs_{};
+  std::vector<int> deps_{};
+  std::vector<int> succs_{};
+  // Number of leading launches that must all finish before this one may
+  // start, i.e. the number of launches issued before the last sync.
+  int barrier_{0};
+  double rank_{0.0};
+};
+
+enum Policy {
+  FIFO,
+  WORK_STEALING,
+  PRIORITY,
+  N_POLICIES, // This must be in the last position.
+};
+
+static const char *policyNames[N_POLICIES] = {"fifo", "ws", "prio"};
+
+struct SimParams {
+  double taskOverhead_{1.0};
+  double launchOverhead_{5.0};
+  double stealOverhead_{2.0};
+  unsigned int seed_{0};
+};
+
+struct SimResult {
+  double makespan_{0.0};
+  double busy_{0.0};
+  long long steals_{0};
+};
+
+struct TaskRef {
+  int launch_;
+  int task_;
+};
+
+struct Event {
+  double time_;
+  bool isRelease_;
+  int thread_;
+  TaskRef ref_;
+
+  bool operator>(const Event &other) const { return time_ > other.time_; }
+};
+
+void usage(const char *progname) {
+  printf("Usage: %s [options] tracefile\n", progname);
+  printf("Program Options:\n");
+  printf("  -n  --threads <LIST>         Comma-separated thread counts "
+         "(default=%s)\n",
+         DEFAULT_THREAD_COUNTS);
+  printf("  -p  --policies <LIST>        Policies among fifo, ws, prio "
+         "(default=%s)\n",
+         DEFAULT_POLICIES);
+  printf("  -t  --task_overhead <US>     Dispatch cost per task (default=1)\n");
+  printf("  -l  --launch_overhead <US>   Delay before a ready launch's tasks "
+         "can run (default=5)\n");
+  printf("  -s  --steal_overhead <US>    Extra cost of a successful steal "
+         "(default=2)\n");
+  printf("  -r  --seed <INT>             Seed for work-stealing victim "
+         "selection (default=0)\n");
+  printf("  -?  --help                   This message\n");
+}
+
+static std::vector<std::string> splitList(const char *list) {
+  std::vector<std::string> items;
+  std::string cur;
+  for (const char *p = list; *p; ++p) {
+    if (*p == ',') {
+      items.push_back(cur);
+      cur.clear();
+    } else {
+      cur += *p;
+    }
+  }
+  items.push_back(cur);
+  return items;
+}
+
+//
+// loadTrace --
+//
+// Parses a trace written by TracingTaskSystem::writeTrace(). Returns
+// false and prints a message on malformed input.
+static bool loadTrace(const char *filename, std::vector<Launch> &launches) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Error: cannot open trace %s\n", filename);
+    return false;
+  }
+
+  int lastBarrier = 0;
+  int lineNo = 0;
+  char line[1 << 16];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    ++lineNo;
+    char *p = line;
+    char *end;
+    if (strncmp(p, "launch", 6) == 0) {
+      int id = strtol(p + 6, &end, 10);
+      int numTasks = strtol(end, &end, 10);
+      int numDeps = strtol(end, &end, 10);
+      if (id != (int)launches.size() || numTasks < 0 || numDeps < 0) {
+        fprintf(stderr, "Error: %s:%d: bad launch record\n", filename, lineNo);
+        fclose(fp);
+        return false;
+      }
+      Launch l;
+      l.costs_.assign(numTasks, 0.0);
+      l.barrier_ = lastBarrier;
+      for (int i = 0; i < numDeps; ++i) {
+        int dep = strtol(end, &end, 10);
+        if (dep < 0 || dep >= id) {
+          fprintf(stderr, "Error: %s:%d: bad dependency %d\n", filename,
+                  lineNo, dep);
+          fclose(fp);
+          return false;
+        }
+        l.deps_.push_back(dep);
+      }
+      std::sort(l.deps_.begin(), l.deps_.end());
+      l.deps_.erase(std::unique(l.deps_.begin(), l.deps_.end()),
+                    l.deps_.end());
+      launches.push_back(l);
+    } else if (strncmp(p, "sync", 4) == 0) {
+      lastBarrier = launches.size();
+    } else if (strncmp(p, "task", 4) == 0) {
+      int launch = strtol(p + 4, &end, 10);
+      int task = strtol(end, &end, 10);
+      double cost = strtod(end, &end);
+      if (launch < 0 || launch >= (int)launches.size() || task < 0 ||
+          task >= (int)launches[launch].costs_.size()) {
+        fprintf(stderr, "Error: %s:%d: bad task record\n", filename, lineNo);
+        fclose(fp);
+        return false;
+      }
+      launches[launch].costs_[task] = cost;
+    }
+  }
+  fclose(fp);
+
+  for (int i = 0; i < (int)launches.size(); ++i) {
+    for (int dep : launches[i].deps_) {
+      launches[dep].succs_.push_back(i);
+    }
+  }
+  return true;
+}
+
+//
+// longestPath --
+//
+// Computes, for every launch, the longest path from the start of that
+// launch to the end of the graph, counting `weight(launch)` for every
+// launch on the path and treating syncs as edges from every earlier
+// launch to every later one. Returns the overall longest path.
+template <typename WeightFn>
+static double longestPath(const std::vector<Launch> &launches,
+                          WeightFn weight, std::vector<double> &out) {
+  int n = launches.size();
+  out.assign(n, 0.0);
+  std::vector<double> suffixMax(n + 1, 0.0);
+  std::vector<int> barriers(n);
+  for (int i = 0; i < n; ++i) {
+    barriers[i] = launches[i].barrier_;
+  }
+
+  for (int i = n - 1; i >= 0; --i) {
+    double tail = 0.0;
+    for (int succ : launches[i].succs_) {
+      tail = std::max(tail, out[succ]);
+    }
+    // Launches whose barrier covers launch i start at the first index
+    // with barrier_ > i; barrier_ is non-decreasing in the launch index.
+    int first = std::upper_bound(barriers.begin(), barriers.end(), i) -
+                barriers.begin();
+    tail = std::max(tail, suffixMax[first]);
+    out[i] = weight(launches[i]) + tail;
+    suffixMax[i] = std::max(out[i], suffixMax[i + 1]);
+  }
+  return suffixMax[0];
+}
+
+static double meanCost(const Launch &l) {
+  if (l.costs_.empty()) {
+    return 0.0;
+  }
+  double sum = 0.0;
+  for (double c : l.costs_) {
+    sum += c;
+  }
+  return sum / l.costs_.size();
+}
+
+static double maxCost(const Launch &l) {
+  double m = 0.0;
+  for (double c : l.costs_) {
+    m = std::max(m, c);
+  }
+  return m;
+}
+
+//
+// Simulator --
+//
+// Replays the trace for one policy at one thread count.
+class Simulator {
+private:
+  const std::vector<Launch> &launches_;
+  Policy policy_;
+  int numThreads_;
+  SimParams params_;
+
+  double now_{0.0};
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>>
+      events_{};
+  std::vector<int> remainingDeps_;
+  std::vector<int> remainingTasks_;
+  std::vector<bool> done_;
+  // Launches whose dependencies are done but whose sync barrier is not,
+  // smallest launch index first.
+  std::priority_queue<int, std::vector<int>, std::greater<int>>
+      blockedByBarrier_{};
+  int prefixDone_{0};
+  int numDone_{0};
+
+  std::deque<TaskRef> fifo_{};
+  std::vector<std::deque<TaskRef>> deques_;
+  struct PrioRef {
+    double rank_;
+    TaskRef ref_;
+    bool operator<(const PrioRef &other) const {
+      if (rank_ != other.rank_) {
+        return rank_ < other.rank_;
+      }
+      if (ref_.launch_ != other.ref_.launch_) {
+        return ref_.launch_ > other.ref_.launch_;
+      }
+      return ref_.task_ > other.ref_.task_;
+    }
+  };
+  std::priority_queue<PrioRef> prio_{};
+  std::mt19937 rng_;
+
+  SimResult result_{};
+
+  void release(int launch, int thread) {
+    if (prefixDone_ < launches_[launch].barrier_) {
+      blockedByBarrier_.push(launch);
+      return;
+    }
+    events_.push({now_ + params_.launchOverhead_, true, thread, {launch, 0}});
+  }
+
+  void enqueue(int launch, int thread) {
+    int numTasks = launches_[launch].costs_.size();
+    if (numTasks == 0) {
+      finish(launch, thread);
+      return;
+    }
+    for (int i = 0; i < numTasks; ++i) {
+      TaskRef ref = {launch, i};
+      if (policy_ == FIFO) {
+        fifo_.push_back(ref);
+      } else if (policy_ == WORK_STEALING) {
+        deques_[thread].push_back(ref);
+      } else {
+        prio_.push({launches_[launch].rank_, ref});
+      }
+    }
+  }
+
+  bool dequeue(int thread, TaskRef &ref, double &extra) {
+    extra = 0.0;
+    if (policy_ == FIFO) {
+      if (fifo_.empty()) {
+        return false;
+      }
+      ref = fifo_.front();
+      fifo_.pop_front();
+      return true;
+    }
+    if (policy_ == PRIORITY) {
+      if (prio_.empty()) {
+        return false;
+      }
+      ref = prio_.top().ref_;
+      prio_.pop();
+      return true;
+    }
+
+    // Work stealing: pop the newest task of our own deque, otherwise
+    // steal the oldest task of the first non-empty victim, starting
+    // from a random one.
+    if (!deques_[thread].empty()) {
+      ref = deques_[thread].back();
+      deques_[thread].pop_back();
+      return true;
+    }
+    int start = rng_() % numThreads_;
+    for (int i = 0; i < numThreads_; ++i) {
+      int victim = (start + i) % numThreads_;
+      if (victim == thread || deques_[victim].empty()) {
+        continue;
+      }
+      ref = deques_[victim].front();
+      deques_[victim].pop_front();
+      extra = params_.stealOverhead_;
+      ++result_.steals_;
+      return true;
+    }
+    return false;
+  }
+
+  void finish(int launch, int thread) {
+    done_[launch] = true;
+    ++numDone_;
+    while (prefixDone_ < (int)launches_.size() && done_[prefixDone_]) {
+      ++prefixDone_;
+    }
+    for (int succ : launches_[launch].succs_) {
+      if (--remainingDeps_[succ] == 0) {
+        release(succ, thread);
+      }
+    }
+    // barrier_ is non-decreasing in the launch index, so once the
+    // smallest blocked launch is still blocked, so are all the others.
+    while (!blockedByBarrier_.empty() &&
+           launches_[blockedByBarrier_.top()].barrier_ <= prefixDone_) {
+      int next = blockedByBarrier_.top();
+      blockedByBarrier_.pop();
+      events_.push({now_ + params_.launchOverhead_, true, thread, {next, 0}});
+    }
+  }
+
+public:
+  Simulator(const std::vector<Launch> &launches, Policy policy,
+            int numThreads, const SimParams &params)
+      : launches_(launches), policy_(policy), numThreads_(numThreads),
+        params_(params), remainingDeps_(launches.size()),
+        remainingTasks_(launches.size()), done_(launches.size(), false),
+        deques_(numThreads), rng_(params.seed_) {}
+
+  bool run(SimResult &result) {
+    int n = launches_.size();
+    for (int i = 0; i < n; ++i) {
+      remainingDeps_[i] = launches_[i].deps_.size();
+      remainingTasks_[i] = launches_[i].costs_.size();
+    }
+    for (int i = 0; i < n; ++i) {
+      if (remainingDeps_[i] == 0) {
+        release(i, 0);
+      }
+    }
+
+    std::vector<bool> idle(numThreads_, true);
+    while (numDone_ < n) {
+      for (int k = 0; k < numThreads_; ++k) {
+        TaskRef ref;
+        double extra;
+        if (idle[k] && dequeue(k, ref, extra)) {
+          double cost = launches_[ref.launch_].costs_[ref.task_];
+          events_.push({now_ + extra + params_.taskOverhead_ + cost, false, k,
+                        ref});
+          result_.busy_ += cost;
+          idle[k] = false;
+        }
+      }
+
+      if (events_.empty()) {
+        fprintf(stderr, "Error: simulation stalled with %d of %d launches "
+                        "done\n",
+                numDone_, n);
+        return false;
+      }
+      Event e = events_.top();
+      events_.pop();
+      now_ = e.time_;
+      if (e.isRelease_) {
+        enqueue(e.ref_.launch_, e.thread_);
+      } else {
+        idle[e.thread_] = true;
+        if (--remainingTasks_[e.ref_.launch_] == 0) {
+          finish(e.ref_.launch_, e.thread_);
+        }
+      }
+    }
+
+    result_.makespan_ = now_;
+    result = result_;
+    return true;
+  }
+};
+
+int main(int argc, char **argv) {
+  const char *threadList = DEFAULT_THREAD_COUNTS;
+  const char *policyList = DEFAULT_POLICIES;
+  SimParams params;
+
+  int opt;
+  static struct option long_options[] = {
+      {"threads", 1, 0, 'n'},         {"policies", 1, 0, 'p'},
+      {"task_overhead", 1, 0, 't'},   {"launch_overhead", 1, 0, 'l'},
+      {"steal_overhead", 1, 0, 's'},  {"seed", 1, 0, 'r'},
+      {"help", 0, 0, '?'},            {0, 0, 0, 0}};
+
+  while ((opt = getopt_long(argc, argv, "n:p:t:l:s:r:?", long_options,
+                            NULL)) != EOF) {
+    switch (opt) {
+    case 'n':
+      threadList = optarg;
+      break;
+    case 'p':
+      policyList = optarg;
+      break;
+    case 't':
+      params.taskOverhead_ = atof(optarg);
+      break;
+    case 'l':
+      params.launchOverhead_ = atof(optarg);
+      break;
+    case 's':
+      params.stealOverhead_ = atof(optarg);
+      break;
+    case 'r':
+      params.seed_ = atoi(optarg);
+      break;
+    case '?':
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind + 1 > argc) {
+    fprintf(stderr, "Error: missing trace file!\n");
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<int> threadCounts;
+  for (const std::string &s : splitList(threadList)) {
+    int n = atoi(s.c_str());
+    if (n <= 0) {
+      fprintf(stderr, "Error: invalid thread count '%s'\n", s.c_str());
+      return 1;
+    }
+    threadCounts.push_back(n);
+  }
+
+  std::vector<Policy> policies;
+  for (const std::string &s : splitList(policyList)) {
+    int p = 0;
+    while (p < N_POLICIES && s != policyNames[p]) {
+      ++p;
+    }
+    if (p == N_POLICIES) {
+      fprintf(stderr, "Error: invalid policy '%s'\n", s.c_str());
+      return 1;
+    }
+    policies.push_back((Policy)p);
+  }
+
+  std::vector<Launch> launches;
+  if (!loadTrace(argv[optind], launches)) {
+    return 1;
+  }
+
+  long long numTasks = 0;
+  double totalWork = 0.0;
+  for (const Launch &l : launches) {
+    numTasks += l.costs_.size();
+    for (double c : l.costs_) {
+      totalWork += c;
+    }
+  }
+  std::vector<double> ranks;
+  double criticalPath = longestPath(launches, maxCost, ranks);
+  longestPath(launches, meanCost, ranks);
+  for (size_t i = 0; i < launches.size(); ++i) {
+    launches[i].rank_ = ranks[i];
+  }
+
+  printf("==================================================================="
+         "================\n");
+  printf("Trace: %s\n", argv[optind]);
+  printf("  %d launches, %lld tasks, total work %.3f ms, critical path "
+         "%.3f ms\n",
+         (int)launches.size(), numTasks, totalWork / 1000,
+         criticalPath / 1000);
+  printf("  overheads: task %.2f us, launch %.2f us, steal %.2f us\n",
+         params.taskOverhead_, params.launchOverhead_, params.stealOverhead_);
+  printf("==================================================================="
+         "================\n");
+  printf("%-8s %8s %14s %10s %12s %10s\n", "policy", "threads",
+         "makespan (ms)", "speedup", "utilization", "steals");
+
+  for (Policy policy : policies) {
+    for (int numThreads : threadCounts) {
+      Simulator sim(launches, policy, numThreads, params);
+      SimResult result;
+      if (!sim.run(result)) {
+        return 1;
+      }
+      double makespan = std::max(result.makespan_, 1e-9);
+      printf("%-8s %8d %14.3f %9.2fx %11.1f%% %10lld\n", policyNames[policy],
+             numThreads, makespan / 1000, totalWork / makespan,
+             100.0 * result.busy_ / (numThreads * makespan), result.steals_);
+    }
+  }
+  printf("==================================================================="
+         "================\n");
+
+  return 0;
+}